@@ -1,5 +1,4 @@
 #include "repeater/websocket_client.hpp"
-#include "repeater/plain_websocket_client.hpp"
 #include "nlohmann/json.hpp"
 
 #include <iostream>
@@ -32,6 +31,7 @@ public:
         auto const repeater_url = "ws://" + (repeater_host == "0.0.0.0" ? "127.0.0.1" : repeater_host) + ":" + std::to_string(repeater_port);
         auto const okx_url = config_["okx_connections"][0].get<std::string>();
         auto const sub_message = config_["subscription_message"].dump();
+        auto const socket_profile = repeater::SocketProfile::from_json(config_.value("socket_profile", nlohmann::json::object()));
 
         net::io_context ioc;
         ssl::context ctx{ssl::context::tlsv12_client};
@@ -39,11 +39,12 @@ public:
         ctx.set_verify_mode(ssl::verify_peer);
 
         // 创建两个客户端
-        auto okx_client = std::make_shared<repeater::WebSocketClient>(ioc, ctx, okx_url, sub_message, 
-            [this](const std::string& msg) { this->on_okx_message(msg); }, debug_, 1);
+        auto okx_client = repeater::make_websocket_client(ioc, repeater::TlsTransport{ctx}, okx_url, {sub_message},
+            [this](std::string_view msg) { this->on_okx_message(msg); }, socket_profile, debug_, 1);
             
-        auto repeater_client = std::make_shared<repeater::PlainWebSocketClient>(ioc, repeater_url, "{}",
-            [this](const std::string& msg) { this->on_repeater_message(msg); }, debug_, 2);
+        // repeater按需订阅上游，因此向repeater发送同样的订阅请求
+        auto repeater_client = repeater::make_websocket_client(ioc, repeater::PlainTransport{}, repeater_url, {sub_message},
+            [this](std::string_view msg) { this->on_repeater_message(msg); }, socket_profile, debug_, 2);
 
         // 启动客户端
         okx_client->run();
@@ -63,7 +64,7 @@ public:
     }
 
 private:
-    void on_okx_message(const std::string& message) {
+    void on_okx_message(std::string_view message) {
         auto now = high_res_clock::now();
         try {
             auto json_msg = nlohmann::json::parse(message);
@@ -75,7 +76,7 @@ private:
         } catch (...) {}
     }
 
-    void on_repeater_message(const std::string& message) {
+    void on_repeater_message(std::string_view message) {
         auto now = high_res_clock::now();
         try {
             auto json_msg = nlohmann::json::parse(message);
@@ -0,0 +1,384 @@
+#include "repeater/websocket_client.hpp"
+#include "repeater/websocket_server.hpp"
+#include "repeater/message_pool.hpp"
+#include "repeater/json_scan.hpp"
+#include "nlohmann/json.hpp"
+
+#include <boost/beast/http.hpp>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using steady_clock = std::chrono::steady_clock;
+
+namespace {
+
+std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// 一条合成消息的投递记录，所有订阅者的读循环并发更新
+struct Slot {
+    std::atomic<std::int64_t> sent_ns{0};
+    std::atomic<std::int64_t> first_ns{0};  // 第一个订阅者收到的时间
+    std::atomic<std::int64_t> last_ns{0};   // 最后一个订阅者收到的时间(所有订阅者都收到时才有效)
+    std::atomic<std::uint32_t> count{0};
+};
+
+struct Step {
+    std::int64_t base_seq = 0;
+    std::size_t size = 0;
+    std::uint32_t sessions = 0;
+    std::unique_ptr<Slot[]> slots;
+};
+
+struct StepResult {
+    std::size_t sessions = 0;
+    int rate = 0;
+    std::size_t sent = 0;
+    double deliveries_per_sec = 0;
+    double complete_pct = 0;
+    double first_p50_us = 0, first_p99_us = 0;
+    double last_p50_us = 0, last_p99_us = 0, last_max_us = 0;
+    double rss_mb = 0;
+    double rss_per_session_kb = 0;
+};
+
+double percentile_us(std::vector<std::int64_t>& values, double p) {
+    if (values.empty()) return 0;
+    auto const index = static_cast<std::size_t>(p * static_cast<double>(values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(index), values.end());
+    return static_cast<double>(values[index]) / 1000.0;
+}
+
+} // namespace
+
+/**
+ * 下游扇出的压测工具。
+ *
+ * 工具自己在source_port上提供一个合成的上游(与OKX相同格式的bbo-tbt消息)，repeater以ws://连接它；
+ * 然后逐级打开session_counts个下游连接，在每一级上按rates依次发送duration_sec秒，统计每条消息
+ * 第一个和最后一个订阅者的投递延迟、吞吐以及repeater每个会话占用的内存(来自控制接口的/status)。
+ */
+class FanoutBench {
+public:
+    explicit FanoutBench(const nlohmann::json& config)
+        : config_(config),
+          bench_(config.value("fanout_bench", nlohmann::json::object())),
+          socket_profile_(repeater::SocketProfile::from_json(config.value("socket_profile", nlohmann::json::object()))),
+          source_pool_(4096, 16384) {}
+
+    void run() {
+        raise_fd_limit();
+
+        auto const source_port = bench_.value("source_port", 9100);
+        auto const session_counts = bench_.value("session_counts", std::vector<std::size_t>{1, 10, 100, 1000, 10000});
+        auto const rates = bench_.value("rates", std::vector<int>{1000, 10000});
+        duration_ = std::chrono::seconds(bench_.value("duration_sec", 5));
+        payload_bytes_ = bench_.value("payload_bytes", std::size_t{256});
+        drain_timeout_ = std::chrono::seconds(bench_.value("drain_timeout_sec", 30));
+        auto const threads = bench_.value("threads", static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+
+        auto const repeater_host = config_["repeater_server"]["host"].get<std::string>();
+        repeater_url_ = "ws://" + (repeater_host == "0.0.0.0" ? std::string("127.0.0.1") : repeater_host) + ":" +
+                        std::to_string(config_["repeater_server"]["port"].get<unsigned short>()) + "/";
+
+        // 1. 合成上游
+        source_ = std::make_shared<repeater::WebSocketServer>(source_ioc_,
+            tcp::endpoint{net::ip::make_address("127.0.0.1"), static_cast<unsigned short>(source_port)},
+            socket_profile_, source_pool_, 0, false);
+        source_->run();
+
+        // 合成上游使用独立的线程，发送不会被订阅者的读回调拖慢
+        auto source_work = net::make_work_guard(source_ioc_);
+        std::thread source_thread([this] { source_ioc_.run(); });
+        auto work = net::make_work_guard(ioc_);
+        std::vector<std::thread> pool;
+        for (int i = 0; i < threads; ++i) pool.emplace_back([this] { ioc_.run(); });
+
+        std::cout << "[FanoutBench] Synthetic source on ws://127.0.0.1:" << source_port
+                  << ", waiting for the repeater to connect..." << std::endl;
+        if (!wait_until([this] { return source_->session_count() > 0; }, std::chrono::seconds(60))) {
+            std::cerr << "[FanoutBench] The repeater did not connect to the synthetic source. "
+                         "Point its okx_connections at ws://127.0.0.1:" << source_port << "/" << std::endl;
+        } else {
+            auto const baseline = control_status();
+            baseline_rss_ = baseline.value("rss_bytes", std::size_t{0});
+
+            // 2. 逐级增加下游连接
+            std::vector<StepResult> results;
+            for (auto const count : session_counts) {
+                add_sessions(count);
+                if (!wait_for_sessions(count)) {
+                    std::cerr << "[FanoutBench] Only some of the " << count << " sessions connected, stopping." << std::endl;
+                    break;
+                }
+                for (auto const rate : rates) {
+                    results.push_back(run_step(count, rate));
+                    print(results.back());
+                }
+            }
+            write_csv(results);
+        }
+
+        for (auto const& client : clients_) client->stop();
+        work.reset();
+        ioc_.stop();
+        for (auto& t : pool) t.join();
+        source_work.reset();
+        source_ioc_.stop();
+        source_thread.join();
+    }
+
+private:
+    static void raise_fd_limit() {
+        rlimit limit{};
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    }
+
+    template <class Predicate, class Duration>
+    static bool wait_until(Predicate done, Duration timeout) {
+        auto const deadline = steady_clock::now() + timeout;
+        while (!done()) {
+            if (steady_clock::now() > deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        return true;
+    }
+
+    void add_sessions(std::size_t target) {
+        // 分批连接，避免一次性的SYN超过监听队列
+        while (clients_.size() < target) {
+            auto const batch_end = std::min(target, clients_.size() + 256);
+            while (clients_.size() < batch_end) {
+                auto const id = static_cast<int>(clients_.size());
+                clients_.push_back(repeater::make_websocket_client(ioc_, repeater::PlainTransport{}, repeater_url_, {},
+                    [this](std::string_view msg) { on_message(msg); }, socket_profile_, false, id));
+                clients_.back()->run();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    bool wait_for_sessions(std::size_t count) {
+        if (!config_.contains("control")) {
+            std::this_thread::sleep_for(std::chrono::seconds(5));
+            return true;
+        }
+        return wait_until([&] { return control_status().value("sessions", std::size_t{0}) >= count; },
+                          std::chrono::seconds(120));
+    }
+
+    nlohmann::json control_status() {
+        if (!config_.contains("control")) return nlohmann::json::object();
+        try {
+            net::io_context ioc;
+            beast::tcp_stream stream(ioc);
+            auto const host = config_["control"]["host"].get<std::string>();
+            stream.connect(tcp::endpoint{net::ip::make_address(host), config_["control"]["port"].get<unsigned short>()});
+            http::request<http::empty_body> req{http::verb::get, "/status", 11};
+            req.set(http::field::host, host);
+            http::write(stream, req);
+            beast::flat_buffer buffer;
+            http::response<http::string_body> res;
+            http::read(stream, buffer, res);
+            return nlohmann::json::parse(res.body());
+        } catch (const std::exception& e) {
+            std::cerr << "[FanoutBench] Control status failed: " << e.what() << std::endl;
+            return nlohmann::json::object();
+        }
+    }
+
+    std::string make_message(std::int64_t seq) const {
+        auto const ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        std::string msg = R"({"arg":{"channel":"bbo-tbt","instId":"BENCH-USDT"},"data":[{"asks":[["100.0","1","0","1"]],)"
+                          R"("bids":[["99.9","1","0","1"]],"ts":")" + std::to_string(ms) + R"(","seqId":)" +
+                          std::to_string(seq) + R"(,"pad":")";
+        if (msg.size() + 5 < payload_bytes_) msg.append(payload_bytes_ - msg.size() - 5, 'x');
+        msg += "\"}]}";
+        return msg;
+    }
+
+    StepResult run_step(std::size_t sessions, int rate) {
+        auto step = std::make_unique<Step>();
+        auto const total = static_cast<std::size_t>(rate) * static_cast<std::size_t>(duration_.count());
+        step->base_seq = next_seq_;
+        step->size = total;
+        step->sessions = static_cast<std::uint32_t>(sessions);
+        step->slots = std::make_unique<Slot[]>(total);
+        current_.store(step.get(), std::memory_order_release);
+
+        // 按速率发送：每次醒来把到期的消息一次发完，高速率时不依赖sleep的精度
+        auto const start = steady_clock::now();
+        auto const start_ns = now_ns();
+        std::size_t sent = 0;
+        while (sent < total) {
+            auto const elapsed = std::chrono::duration<double>(steady_clock::now() - start).count();
+            auto const due = std::min(total, static_cast<std::size_t>(elapsed * rate) + 1);
+            for (; sent < due; ++sent) {
+                auto const msg = make_message(next_seq_++);
+                step->slots[sent].sent_ns.store(now_ns(), std::memory_order_relaxed);
+                source_->broadcast(msg);
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        // 等待积压排空：最后一条消息送达所有订阅者，且投递数不再增长，否则积压会拖慢下一步
+        auto const delivered = [&] {
+            std::uint64_t sum = 0;
+            for (std::size_t i = 0; i < total; ++i) sum += step->slots[i].count.load(std::memory_order_relaxed);
+            return sum;
+        };
+        wait_until([&] { return step->slots[total - 1].count.load() >= sessions; }, drain_timeout_);
+        auto drained_ns = now_ns();
+        for (auto before = delivered();;) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            auto const after = delivered();
+            if (after == before) break;
+            before = after;
+            drained_ns = now_ns();
+        }
+        current_.store(nullptr, std::memory_order_release);
+
+        StepResult result;
+        result.sessions = sessions;
+        result.rate = rate;
+        result.sent = total;
+        std::vector<std::int64_t> first;
+        std::vector<std::int64_t> last;
+        first.reserve(total);
+        last.reserve(total);
+        std::uint64_t deliveries = 0;
+        std::size_t complete = 0;
+        std::int64_t last_arrival_ns = 0;
+        for (std::size_t i = 0; i < total; ++i) {
+            auto const& slot = step->slots[i];
+            auto const count = slot.count.load();
+            deliveries += count;
+            if (count > 0) first.push_back(slot.first_ns.load() - slot.sent_ns.load());
+            if (count >= sessions) {
+                ++complete;
+                last.push_back(slot.last_ns.load() - slot.sent_ns.load());
+                last_arrival_ns = std::max(last_arrival_ns, slot.last_ns.load());
+            }
+        }
+        // 吞吐按发送开始到最后一次投递计算；超过发送速率的积压会体现为更长的耗时
+        auto const end_ns = complete == total ? last_arrival_ns : drained_ns;
+        result.deliveries_per_sec = static_cast<double>(deliveries) * 1e9 / static_cast<double>(end_ns - start_ns);
+        result.complete_pct = 100.0 * static_cast<double>(complete) / static_cast<double>(total);
+        result.first_p50_us = percentile_us(first, 0.5);
+        result.first_p99_us = percentile_us(first, 0.99);
+        result.last_p50_us = percentile_us(last, 0.5);
+        result.last_p99_us = percentile_us(last, 0.99);
+        result.last_max_us = last.empty() ? 0 : static_cast<double>(*std::max_element(last.begin(), last.end())) / 1000.0;
+
+        auto const rss = control_status().value("rss_bytes", std::size_t{0});
+        result.rss_mb = static_cast<double>(rss) / (1024.0 * 1024.0);
+        if (rss > baseline_rss_) {
+            result.rss_per_session_kb = static_cast<double>(rss - baseline_rss_) / 1024.0 / static_cast<double>(sessions);
+        }
+        steps_.push_back(std::move(step));  // 迟到的读回调可能仍持有指针，留到退出时释放
+        return result;
+    }
+
+    void on_message(std::string_view message) {
+        auto const* step = current_.load(std::memory_order_acquire);
+        if (!step) return;
+        auto const first = repeater::json_scan::first_element(repeater::json_scan::find_field(message, "data"));
+        auto const seq = repeater::json_scan::to_int64(repeater::json_scan::find_field(first, "seqId"));
+        if (!seq) return;
+        auto const index = *seq - step->base_seq;
+        if (index < 0 || static_cast<std::size_t>(index) >= step->size) return;
+
+        auto& slot = step->slots[static_cast<std::size_t>(index)];
+        auto const now = now_ns();
+        std::int64_t expected = 0;
+        slot.first_ns.compare_exchange_strong(expected, now, std::memory_order_relaxed);
+        // 计数到达订阅者总数的那一次就是最后一个订阅者
+        if (slot.count.fetch_add(1, std::memory_order_relaxed) + 1 == step->sessions) {
+            slot.last_ns.store(now, std::memory_order_relaxed);
+        }
+    }
+
+    static void print_header() {
+        std::cout << std::right << std::setw(9) << "sessions" << std::setw(8) << "rate" << std::setw(14) << "deliveries/s"
+                  << std::setw(11) << "complete%" << std::setw(12) << "first p50" << std::setw(12) << "first p99"
+                  << std::setw(12) << "last p50" << std::setw(12) << "last p99" << std::setw(12) << "last max"
+                  << std::setw(10) << "rss MB" << std::setw(12) << "KB/session" << std::endl;
+    }
+
+    void print(const StepResult& r) {
+        if (!header_printed_) {
+            print_header();
+            header_printed_ = true;
+        }
+        std::cout << std::fixed << std::setprecision(1) << std::right << std::setw(9) << r.sessions << std::setw(8) << r.rate
+                  << std::setw(14) << r.deliveries_per_sec << std::setw(11) << r.complete_pct
+                  << std::setw(12) << r.first_p50_us << std::setw(12) << r.first_p99_us
+                  << std::setw(12) << r.last_p50_us << std::setw(12) << r.last_p99_us << std::setw(12) << r.last_max_us
+                  << std::setw(10) << r.rss_mb << std::setw(12) << r.rss_per_session_kb << std::endl;
+    }
+
+    void write_csv(const std::vector<StepResult>& results) {
+        auto const path = bench_.value("csv", std::string{});
+        if (path.empty()) return;
+        std::ofstream out(path);
+        out << "sessions,rate,sent,deliveries_per_sec,complete_pct,first_p50_us,first_p99_us,"
+               "last_p50_us,last_p99_us,last_max_us,rss_mb,rss_per_session_kb\n";
+        for (auto const& r : results) {
+            out << r.sessions << "," << r.rate << "," << r.sent << "," << r.deliveries_per_sec << "," << r.complete_pct << ","
+                << r.first_p50_us << "," << r.first_p99_us << "," << r.last_p50_us << "," << r.last_p99_us << ","
+                << r.last_max_us << "," << r.rss_mb << "," << r.rss_per_session_kb << "\n";
+        }
+        std::cout << "[FanoutBench] Scaling curve written to " << path << std::endl;
+    }
+
+    nlohmann::json config_;
+    nlohmann::json bench_;
+    repeater::SocketProfile socket_profile_;
+    repeater::MessagePool source_pool_;
+    net::io_context source_ioc_;
+    net::io_context ioc_;
+    std::shared_ptr<repeater::WebSocketServer> source_;
+    std::vector<std::shared_ptr<repeater::WebSocketClient>> clients_;
+    std::string repeater_url_;
+    std::chrono::seconds duration_{5};
+    std::chrono::seconds drain_timeout_{30};
+    std::size_t payload_bytes_ = 256;
+    std::size_t baseline_rss_ = 0;
+    std::int64_t next_seq_ = 1;
+    std::atomic<Step*> current_{nullptr};
+    std::vector<std::unique_ptr<Step>> steps_;
+    bool header_printed_ = false;
+};
+
+int main(int argc, char* argv[]) {
+    try {
+        std::string const config_path = argc > 1 ? argv[1] : "../config/fanout_bench_config.json";
+        std::ifstream config_file(config_path);
+        if (!config_file.is_open()) {
+            std::cerr << "Error: Could not open " << config_path << std::endl;
+            return EXIT_FAILURE;
+        }
+        nlohmann::json config;
+        config_file >> config;
+
+        FanoutBench bench(config);
+        bench.run();
+    } catch (const std::exception& e) {
+        std::cerr << "An unexpected error occurred: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+#include "repeater/log.hpp"
+#include "repeater/message_processor.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using steady_clock = std::chrono::steady_clock;
+
+/**
+ * 日志开销的微基准。
+ *
+ * 对比同步的std::cout << ... << std::endl(输出重定向到/dev/null，仍然每行一次flush)与异步二进制日志
+ * 在各种情况下调用线程上的耗时，以及MessageProcessor::process在debug打开/关闭时的耗时。
+ * 每轮burst条调用之后暂停一个日志轮询间隔，让后台线程写空队列，测到的是没有丢弃时的调用开销。
+ */
+namespace {
+
+struct Result {
+    std::string name;
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double max_ns;
+};
+
+constexpr std::size_t burst = 1000;
+constexpr auto pause = std::chrono::milliseconds(10);
+
+Result measure(const std::string& name, std::size_t iterations, const std::function<void(std::uint64_t)>& op) {
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    double total_ns = 0;
+    for (std::uint64_t i = 0; i < iterations;) {
+        // 每次调用都包含一次steady_clock::now()的开销，见 "clock overhead" 一行
+        auto const burst_start = steady_clock::now();
+        auto const n = std::min<std::uint64_t>(burst, iterations - i);
+        for (std::uint64_t k = 0; k < n; ++k, ++i) {
+            auto const start = steady_clock::now();
+            op(i);
+            samples.push_back(std::chrono::duration<double, std::nano>(steady_clock::now() - start).count());
+        }
+        total_ns += std::chrono::duration<double, std::nano>(steady_clock::now() - burst_start).count();
+        std::this_thread::sleep_for(pause);
+    }
+    std::sort(samples.begin(), samples.end());
+    auto const at = [&](double q) { return samples[static_cast<std::size_t>(q * (samples.size() - 1))]; };
+    return {name, total_ns / static_cast<double>(iterations), at(0.5), at(0.99), samples.back()};
+}
+
+std::string book_message(std::uint64_t seq) {
+    return R"({"arg":{"channel":"bbo-tbt","instId":"BENCH-USDT"},"data":[{"asks":[["65000.1","0.5","0","1"]],)"
+           R"("bids":[["64999.9","0.7","0","2"]],"ts":"1700000000000","seqId":)" + std::to_string(seq) + "}]}";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    auto const iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000ULL;
+
+    // 同步基线：与原来的调试输出相同的写法，输出到/dev/null
+    std::ofstream null_stream("/dev/null");
+    auto* const console = std::cout.rdbuf(null_stream.rdbuf());
+    std::vector<Result> results;
+    results.push_back(measure("clock overhead", iterations, [](std::uint64_t) {}));
+    std::string const channel = "bbo-tbt";
+    std::string const inst_id = "BENCH-USDT";
+    results.push_back(measure("std::cout << std::endl", iterations, [&](std::uint64_t i) {
+        std::cout << "[Processor] Forwarding newest message on " << channel << ":" << inst_id << " (seqId " << i
+                  << ") from source " << 1 << std::endl;
+    }));
+    std::cout.rdbuf(console);
+
+    repeater::log::Options options;
+    options.level = repeater::log::Level::debug;
+    options.file = "/dev/null";
+    options.rate_limit = 0;
+    repeater::log::configure(options);
+
+    results.push_back(measure("REPEATER_LOG enabled", iterations, [&](std::uint64_t i) {
+        REPEATER_LOG(debug, "[Processor] Forwarding newest message on {}:{} (seqId {}) from source {}", channel,
+                     inst_id, i, 1);
+    }));
+
+    // 级别低于配置时参数不求值，只剩一次原子读
+    repeater::log::Options filtered = options;
+    filtered.level = repeater::log::Level::info;
+    repeater::log::configure(filtered);
+    results.push_back(measure("REPEATER_LOG below level", iterations, [&](std::uint64_t i) {
+        REPEATER_LOG(debug, "[Processor] Forwarding newest message on {}:{} (seqId {}) from source {}", channel,
+                     inst_id, i, 1);
+    }));
+
+    // 限速：每秒只放过一条，其余在调用点计数后返回
+    repeater::log::Options limited = options;
+    limited.rate_limit = 1;
+    repeater::log::configure(limited);
+    results.push_back(measure("REPEATER_LOG rate-limited", iterations, [&](std::uint64_t i) {
+        REPEATER_LOG(debug, "[Processor] Rate-limited record {} on {}:{}", i, channel, inst_id);
+    }));
+    repeater::log::configure(options);
+
+    // 处理器的热路径：每条消息先后从两个来源到达，一次转发一次重复，debug打开时各写一条日志。
+    // 先用一个丢弃结果的处理器预热代码和分配器，两种情况在同样的条件下比较
+    {
+        repeater::MessageProcessor warmup([](const repeater::ForwardedMessage&) {}, false);
+        for (std::uint64_t i = 0; i < iterations; ++i) warmup.process(book_message(i / 2 + 1), static_cast<int>(i % 2) + 1);
+    }
+    for (bool const debug : {false, true}) {
+        std::uint64_t forwarded = 0;
+        repeater::MessageProcessor processor([&](const repeater::ForwardedMessage&) { ++forwarded; }, debug);
+        std::vector<std::string> messages;
+        messages.reserve(iterations);
+        for (std::uint64_t i = 0; i < iterations / 2 + 1; ++i) messages.push_back(book_message(i + 1));
+        results.push_back(measure(std::string("MessageProcessor::process debug=") + (debug ? "true" : "false"),
+                                  iterations, [&](std::uint64_t i) {
+            processor.process(messages[i / 2], static_cast<int>(i % 2) + 1);
+        }));
+    }
+    repeater::log::shutdown();
+
+    std::cout << std::left << std::setw(40) << "case" << std::right << std::setw(12) << "mean ns" << std::setw(12)
+              << "p50 ns" << std::setw(12) << "p99 ns" << std::setw(12) << "max ns" << "\n";
+    std::cout << std::fixed << std::setprecision(1);
+    for (auto const& r : results) {
+        std::cout << std::left << std::setw(40) << r.name << std::right << std::setw(12) << r.mean_ns << std::setw(12)
+                  << r.p50_ns << std::setw(12) << r.p99_ns << std::setw(12) << r.max_ns << "\n";
+    }
+    std::cout << "records dropped (queue full): " << repeater::log::dropped() << std::endl;
+    return 0;
+}
@@ -4,19 +4,20 @@
 #include <fstream>
 #include <string>
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
-        // 加载配置文件
-        std::ifstream config_file("../config/repeater_config.json");
+        // 加载配置文件，可通过第一个参数指定路径(例如在同一台机器上运行多个联邦节点)
+        std::string const config_path = argc > 1 ? argv[1] : "../config/repeater_config.json";
+        std::ifstream config_file(config_path);
         if (!config_file.is_open()) {
-            std::cerr << "Error: Could not open config/repeater_config.json" << std::endl;
+            std::cerr << "Error: Could not open " << config_path << std::endl;
             return EXIT_FAILURE;
         }
 
         nlohmann::json config;
         config_file >> config;
 
-        repeater::RepeaterCore core(config);
+        repeater::RepeaterCore core(config, config_path);
         core.run();
 
     } catch (const nlohmann::json::exception& e) {
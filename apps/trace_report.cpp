@@ -0,0 +1,160 @@
+#include "repeater/trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 把repeater导出的trace文件转换为分阶段的延迟分解：
+//   trace_report <dump.bin>... [--top N]
+// 每个阶段打印分位数，并列出读到写完成最慢的N次投递及其每个阶段的耗时。
+
+namespace {
+
+using repeater::trace::Record;
+using repeater::trace::Stage;
+
+struct Delivery {
+    std::uint64_t enqueue = 0;
+    std::uint64_t write = 0;
+};
+
+struct Trace {
+    std::uint64_t read = 0;
+    std::uint64_t extract = 0;
+    std::uint64_t dedup = 0;
+    std::uint32_t source = 0;
+    bool forwarded = false;
+    std::unordered_map<std::uint32_t, Delivery> deliveries;
+};
+
+constexpr const char* stage_names[] = {"read->extract", "extract->dedup", "dedup->enqueue", "enqueue->write", "read->write"};
+constexpr std::size_t stage_count = 5;
+
+struct Slow {
+    std::uint64_t id;
+    std::uint32_t session;
+    double stages[stage_count];
+};
+
+bool load(const std::string& path, std::vector<Record>& records, double& tsc_per_ns) {
+    std::ifstream in(path, std::ios::binary);
+    repeater::trace::DumpHeader header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, repeater::trace::dump_magic, sizeof(header.magic)) != 0) {
+        std::cerr << "Error: " << path << " is not a repeater trace dump" << std::endl;
+        return false;
+    }
+    auto const offset = records.size();
+    records.resize(offset + header.record_count);
+    if (!in.read(reinterpret_cast<char*>(records.data() + offset),
+                 static_cast<std::streamsize>(header.record_count * sizeof(Record)))) {
+        std::cerr << "Error: " << path << " is truncated" << std::endl;
+        return false;
+    }
+    tsc_per_ns = header.tsc_per_ns;
+    return true;
+}
+
+double percentile(std::vector<double>& values, double p) {
+    if (values.empty()) return 0;
+    auto const index = static_cast<std::size_t>(p * static_cast<double>(values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(index), values.end());
+    return values[index];
+}
+
+// 两个时间戳之间的微秒数；任一端缺失(被环形缓冲区覆盖)时返回负数
+double micros(std::uint64_t from, std::uint64_t to, double tsc_per_ns) {
+    if (from == 0 || to == 0 || to < from) return -1;
+    return static_cast<double>(to - from) / tsc_per_ns / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    std::size_t top = 10;
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        if (arg == "--top" && i + 1 < argc) {
+            top = std::stoul(argv[++i]);
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        std::cerr << "Usage: trace_report <dump.bin>... [--top N]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Record> records;
+    double tsc_per_ns = 1.0;
+    for (auto const& path : paths) {
+        if (!load(path, records, tsc_per_ns)) return EXIT_FAILURE;
+    }
+
+    std::unordered_map<std::uint64_t, Trace> traces;
+    for (auto const& r : records) {
+        auto& t = traces[r.id];
+        switch (r.stage) {
+            case Stage::read: t.read = r.tsc; t.source = r.detail; break;
+            case Stage::extract: t.extract = r.tsc; break;
+            case Stage::dedup: t.dedup = r.tsc; t.forwarded = r.detail != 0; break;
+            case Stage::enqueue: t.deliveries[r.detail].enqueue = r.tsc; break;
+            case Stage::write: t.deliveries[r.detail].write = r.tsc; break;
+            default: break;
+        }
+    }
+
+    std::vector<double> samples[stage_count];
+    std::vector<Slow> slow;
+    std::size_t forwarded = 0;
+    std::size_t dropped = 0;
+    for (auto const& [id, t] : traces) {
+        if (t.dedup) (t.forwarded ? forwarded : dropped)++;
+        if (auto const v = micros(t.read, t.extract, tsc_per_ns); v >= 0) samples[0].push_back(v);
+        if (auto const v = micros(t.extract, t.dedup, tsc_per_ns); v >= 0) samples[1].push_back(v);
+        for (auto const& [session, d] : t.deliveries) {
+            Slow s{id, session, {micros(t.read, t.extract, tsc_per_ns), micros(t.extract, t.dedup, tsc_per_ns),
+                                 micros(t.dedup, d.enqueue, tsc_per_ns), micros(d.enqueue, d.write, tsc_per_ns),
+                                 micros(t.read, d.write, tsc_per_ns)}};
+            for (std::size_t i = 2; i < stage_count; ++i) {
+                if (s.stages[i] >= 0) samples[i].push_back(s.stages[i]);
+            }
+            if (s.stages[4] >= 0) slow.push_back(s);
+        }
+    }
+
+    std::cout << records.size() << " records, " << traces.size() << " messages (" << forwarded << " forwarded, "
+              << dropped << " dropped by dedup), TSC " << std::setprecision(4) << tsc_per_ns << " ticks/ns\n\n";
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::left << std::setw(16) << "stage (us)" << std::right << std::setw(10) << "count"
+              << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+              << std::setw(10) << "p99.9" << std::setw(12) << "max" << "\n";
+    for (std::size_t i = 0; i < stage_count; ++i) {
+        auto& v = samples[i];
+        auto const max = v.empty() ? 0.0 : *std::max_element(v.begin(), v.end());
+        std::cout << std::left << std::setw(16) << stage_names[i] << std::right << std::setw(10) << v.size()
+                  << std::setw(10) << percentile(v, 0.5) << std::setw(10) << percentile(v, 0.9)
+                  << std::setw(10) << percentile(v, 0.99) << std::setw(10) << percentile(v, 0.999)
+                  << std::setw(12) << max << "\n";
+    }
+
+    top = std::min(top, slow.size());
+    std::partial_sort(slow.begin(), slow.begin() + static_cast<std::ptrdiff_t>(top), slow.end(),
+                      [](const Slow& a, const Slow& b) { return a.stages[4] > b.stages[4]; });
+    std::cout << "\nSlowest " << top << " deliveries (us, -1 = stamp overwritten):\n";
+    for (std::size_t i = 0; i < top; ++i) {
+        auto const& s = slow[i];
+        std::cout << "  id " << std::hex << s.id << std::dec << " source " << traces[s.id].source
+                  << " session " << s.session << ":";
+        for (std::size_t k = 0; k < stage_count; ++k) {
+            std::cout << " " << stage_names[k] << "=" << s.stages[k];
+        }
+        std::cout << "\n";
+    }
+    return EXIT_SUCCESS;
+}
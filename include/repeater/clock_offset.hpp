@@ -0,0 +1,96 @@
+#ifndef REPEATER_CLOCK_OFFSET_HPP
+#define REPEATER_CLOCK_OFFSET_HPP
+
+#include "nlohmann/json.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace repeater {
+
+/**
+ * 过时数据保护的配置，对应配置文件中的 "stale_guard" 对象。
+ */
+struct StaleGuardOptions {
+    std::int64_t max_age_us = 0;                   // 消息年龄超过该值视为过时，0表示只估计不拦截
+    bool drop = true;                              // true丢弃过时消息；false照常转发并在消息中标记
+    std::chrono::milliseconds window{10000};       // 估计时钟偏差使用的滑动窗口
+    std::unordered_map<std::string, std::int64_t> channel_max_age_us;  // 按channel覆盖max_age_us
+
+    static StaleGuardOptions from_json(const nlohmann::json& j);
+};
+
+/**
+ * 本地时钟与OKX消息 "ts" 字段之间的偏差估计。
+ *
+ * 每条带ts的消息给出一个样本 delay = 本地接收时间 - ts，它等于时钟偏差加上该条路径的单向延迟。
+ * 所有连接在滑动窗口内的最小样本作为偏差的估计(即最快路径上的偏差加延迟)，
+ * 一条消息的年龄 = 它的样本 - 该最小值，表示它比同一时期最快到达的数据晚了多少。
+ * 每个来源另外维护自己窗口内的最小值和指数平均，减去全局最小值即为该连接相对最快路径的单向延迟。
+ *
+ * 窗口被分为bucket_count个桶，每个桶记录自己时间段内的最小值；observe()只做原子操作，不加锁。
+ */
+class ClockOffsetEstimator {
+public:
+    static constexpr int max_sources = 64;
+    static constexpr std::size_t bucket_count = 8;
+
+    struct SourceLatency {
+        std::int64_t min_us = -1;  // 窗口内最小单向延迟(相对最快路径)，-1表示没有样本
+        std::int64_t avg_us = -1;  // 单向延迟的指数平均(相对最快路径)
+        std::uint64_t samples = 0;
+    };
+
+    explicit ClockOffsetEstimator(std::chrono::milliseconds window);
+
+    /**
+     * @brief 记录一个样本并返回这条消息的年龄(微秒)。
+     */
+    std::int64_t observe(int source_id, std::int64_t exchange_us, std::int64_t local_us);
+
+    /**
+     * @brief 当前的偏差估计(本地时钟 - ts，含最快路径的单向延迟)，窗口内没有样本时为空。
+     */
+    std::optional<std::int64_t> offset_us() const;
+
+    SourceLatency source(int source_id) const;
+
+    /**
+     * @brief 清空某个来源的窗口最小值和平均值，全局的偏差估计不受影响。
+     */
+    void reset_source(int source_id);
+
+private:
+    struct Bucket {
+        std::atomic<std::int64_t> epoch{-1};
+        std::atomic<std::int64_t> min{std::numeric_limits<std::int64_t>::max()};
+    };
+
+    struct WindowMin {
+        std::array<Bucket, bucket_count> buckets;
+
+        void update(std::int64_t epoch, std::int64_t value);
+        std::int64_t get(std::int64_t epoch) const;
+        void clear();
+    };
+
+    struct Source {
+        WindowMin window;
+        std::atomic<std::int64_t> ewma{0};
+        std::atomic<std::uint64_t> samples{0};
+    };
+
+    std::int64_t bucket_us_;
+    WindowMin global_;
+    std::unique_ptr<std::array<Source, max_sources>> sources_;
+};
+
+} // namespace repeater
+
+#endif // REPEATER_CLOCK_OFFSET_HPP
@@ -0,0 +1,45 @@
+#ifndef REPEATER_CONTROL_SERVER_HPP
+#define REPEATER_CONTROL_SERVER_HPP
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/asio/strand.hpp>
+#include <functional>
+#include <memory>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+namespace repeater {
+
+/**
+ * 本地HTTP控制接口。
+ *
+ * 只负责HTTP的收发，每个请求交给handler处理并返回其响应；路由和业务逻辑由RepeaterCore实现。
+ * 控制面不在热路径上，这里不做任何分配优化。
+ */
+class ControlServer : public std::enable_shared_from_this<ControlServer> {
+public:
+    using Request = http::request<http::string_body>;
+    using Response = http::response<http::string_body>;
+    using Handler = std::function<Response(const Request&)>;
+
+    ControlServer(net::io_context& ioc, tcp::endpoint endpoint, Handler handler, bool debug);
+
+    void run();
+
+private:
+    void do_accept();
+    void on_accept(beast::error_code ec, tcp::socket socket);
+
+    net::io_context& ioc_;
+    tcp::acceptor acceptor_;
+    Handler handler_;
+    bool debug_;
+};
+
+} // namespace repeater
+
+#endif // REPEATER_CONTROL_SERVER_HPP
@@ -0,0 +1,210 @@
+#ifndef REPEATER_DEDUP_POLICY_HPP
+#define REPEATER_DEDUP_POLICY_HPP
+
+#include "repeater/json_scan.hpp"
+#include "repeater/runtime_profile.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+namespace repeater {
+
+/**
+ * 去重策略的种类。每个(channel, instId)流根据其channel选择一种策略。
+ */
+enum class DedupKind {
+    seq_id,       // seqId水位线：只转发比已转发的最大seqId更新的消息(订单簿类频道)
+    trade_id,     // tradeId集合：在有界窗口内记住已转发的tradeId(成交类频道)
+    snapshot,     // (ts, 内容哈希)：丢弃ts回退的消息，同一ts下按内容去重(行情快照类频道)
+    pass_through  // 不去重，全部转发
+};
+
+const char* to_string(DedupKind kind);
+std::optional<DedupKind> parse_dedup_kind(std::string_view name);
+
+/**
+ * @brief OKX频道到默认去重策略的映射，可被配置文件中的 "dedup_policies" 覆盖。
+ */
+DedupKind default_dedup_kind(std::string_view channel);
+
+enum class DedupDecision {
+    forward,    // 首次到达，应转发
+    duplicate,  // 重复或过时，丢弃
+    no_key      // 消息缺少该策略需要的字段
+};
+
+/**
+ * 最近N个64位key的有界集合：开放寻址哈希表 + FIFO淘汰环，插入与查找都是O(1)且不分配内存。
+ */
+template <std::size_t Capacity>
+class RecentKeySet {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // 表在流创建时分配一次，放在启动时预留(可能是大页)的区域中
+    static void* operator new(std::size_t bytes) { return hot_allocate(bytes); }
+    static void operator delete(void* pointer) noexcept { hot_deallocate(pointer); }
+
+    /**
+     * @brief 插入key。已存在时返回false；集合已满时先淘汰最早插入的key。
+     */
+    bool insert(std::uint64_t key) {
+        key = key ? key : 1; // 0 表示空槽
+        if (contains(key)) return false;
+        if (size_ == Capacity) {
+            erase(ring_[head_]);
+            --size_;
+        }
+        ring_[head_] = key;
+        head_ = (head_ + 1) & (Capacity - 1);
+        ++size_;
+
+        std::size_t i = slot_of(key);
+        while (table_[i] != 0) i = (i + 1) & mask;
+        table_[i] = key;
+        return true;
+    }
+
+    bool contains(std::uint64_t key) const {
+        key = key ? key : 1;
+        for (std::size_t i = slot_of(key); table_[i] != 0; i = (i + 1) & mask) {
+            if (table_[i] == key) return true;
+        }
+        return false;
+    }
+
+private:
+    static constexpr std::size_t table_size = Capacity * 2;
+    static constexpr std::size_t mask = table_size - 1;
+
+    static std::size_t slot_of(std::uint64_t key) {
+        // splitmix64 finalizer
+        key ^= key >> 30; key *= 0xbf58476d1ce4e5b9ULL;
+        key ^= key >> 27; key *= 0x94d049bb133111ebULL;
+        key ^= key >> 31;
+        return static_cast<std::size_t>(key) & mask;
+    }
+
+    void erase(std::uint64_t key) {
+        std::size_t i = slot_of(key);
+        while (table_[i] != key) {
+            if (table_[i] == 0) return;
+            i = (i + 1) & mask;
+        }
+        table_[i] = 0;
+        // 线性探测的后移删除，保持探测链连续
+        for (std::size_t j = (i + 1) & mask; table_[j] != 0; j = (j + 1) & mask) {
+            const std::size_t ideal = slot_of(table_[j]);
+            const bool movable = (i <= j) ? (ideal <= i || ideal > j) : (ideal <= i && ideal > j);
+            if (movable) {
+                table_[i] = table_[j];
+                table_[j] = 0;
+                i = j;
+            }
+        }
+    }
+
+    std::array<std::uint64_t, table_size> table_{};
+    std::array<std::uint64_t, Capacity> ring_{};
+    std::size_t head_ = 0;
+    std::size_t size_ = 0;
+};
+
+inline std::uint64_t fnv1a(std::string_view bytes, std::uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (unsigned char c : bytes) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * 各策略的状态与判定逻辑。每个策略都是一个独立的具体类型，MessageProcessor按流的策略
+ * 实例化对应的处理路径，seqId路径上没有虚调用，只比原来多一次流查找。
+ *
+ * accept()的参数: data为 "data" 字段的原始数组片段，first为其第一个元素。
+ * accept()在流的锁内调用。
+ */
+struct SeqIdPolicy {
+    static constexpr DedupKind kind = DedupKind::seq_id;
+    int64_t max_seq_id = 0;
+    int64_t last_key = 0;
+
+    DedupDecision accept(std::string_view, std::string_view first) {
+        auto const seq = json_scan::to_int64(json_scan::find_field(first, "seqId"));
+        if (!seq) return DedupDecision::no_key;
+        last_key = *seq;
+        if (*seq <= max_seq_id) return DedupDecision::duplicate;
+        max_seq_id = *seq;
+        return DedupDecision::forward;
+    }
+};
+
+struct TradeIdPolicy {
+    static constexpr DedupKind kind = DedupKind::trade_id;
+    static constexpr std::size_t window = 4096;
+    std::unique_ptr<RecentKeySet<window>> seen = std::make_unique<RecentKeySet<window>>();
+    int64_t last_key = 0;
+
+    DedupDecision accept(std::string_view data, std::string_view first) {
+        // 一条消息可以带多笔成交：每个tradeId都记入窗口，只要有一笔没见过就转发，key取其中最大的tradeId
+        bool found = false;
+        bool fresh = false;
+        int64_t max_key = 0;
+        for (auto element = first; !element.empty(); element = json_scan::next_element(data, element)) {
+            auto const token = json_scan::find_field(element, "tradeId");
+            if (token.empty()) continue;
+            auto const key = json_scan::to_int64(token).value_or(0);
+            max_key = found ? std::max(max_key, key) : key;
+            found = true;
+            if (seen->insert(fnv1a(token))) fresh = true;
+        }
+        if (!found) return DedupDecision::no_key;
+        last_key = max_key;
+        return fresh ? DedupDecision::forward : DedupDecision::duplicate;
+    }
+};
+
+struct SnapshotPolicy {
+    static constexpr DedupKind kind = DedupKind::snapshot;
+    static constexpr std::size_t window = 256;
+    std::unique_ptr<RecentKeySet<window>> seen = std::make_unique<RecentKeySet<window>>();
+    int64_t max_ts = 0;
+    int64_t last_key = 0;
+
+    DedupDecision accept(std::string_view data, std::string_view first) {
+        // 对象形式的元素带 "ts" 字段；candle等数组形式的元素以ts作为第一个值。多个元素时取最大的ts
+        std::optional<int64_t> ts;
+        for (auto element = first; !element.empty(); element = json_scan::next_element(data, element)) {
+            auto const ts_token = element.front() == '['
+                ? json_scan::first_element(element)
+                : json_scan::find_field(element, "ts");
+            auto const element_ts = json_scan::to_int64(ts_token);
+            if (element_ts && (!ts || *element_ts > *ts)) ts = element_ts;
+        }
+        if (!ts) return DedupDecision::no_key;
+        last_key = *ts;
+        if (*ts < max_ts) return DedupDecision::duplicate;
+        // 同一ts可能有多次内容不同的推送(例如未收盘的K线)，因此以(ts, 内容哈希)为key
+        if (!seen->insert(fnv1a(data, static_cast<std::uint64_t>(*ts)))) return DedupDecision::duplicate;
+        max_ts = *ts;
+        return DedupDecision::forward;
+    }
+};
+
+struct PassThroughPolicy {
+    static constexpr DedupKind kind = DedupKind::pass_through;
+    int64_t last_key = 0;
+
+    DedupDecision accept(std::string_view, std::string_view) {
+        return DedupDecision::forward;
+    }
+};
+
+} // namespace repeater
+
+#endif // REPEATER_DEDUP_POLICY_HPP
@@ -0,0 +1,173 @@
+#ifndef REPEATER_HANDLER_MEMORY_HPP
+#define REPEATER_HANDLER_MEMORY_HPP
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace repeater {
+
+/**
+ * 单个连接专用的异步操作内存。
+ *
+ * Asio为每个异步操作分配一个op对象；默认的线程本地回收缓存在操作跨线程完成时经常失效，
+ * 退化为malloc/free。一个连接同一时刻只有少量未完成的操作(一次读、一次写、一次投递)，
+ * 因此预留几个固定大小的块就能覆盖全部热路径分配；放不下时才回退到operator new。
+ * op的释放可能发生在任意I/O线程上(先释放内存再经strand派发handler)，因此块的占用标志是原子的。
+ */
+class HandlerMemory {
+public:
+    static constexpr std::size_t block_size = 1536;
+    static constexpr std::size_t block_count = 4;
+
+    HandlerMemory() = default;
+
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(std::size_t size) {
+        if (size <= block_size) {
+            for (std::size_t i = 0; i < block_count; ++i) {
+                if (!in_use_[i].load(std::memory_order_relaxed) &&
+                    !in_use_[i].exchange(true, std::memory_order_acquire)) {
+                    return &storage_[i];
+                }
+            }
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void* pointer) {
+        for (std::size_t i = 0; i < block_count; ++i) {
+            if (pointer == &storage_[i]) {
+                in_use_[i].store(false, std::memory_order_release);
+                return;
+            }
+        }
+        ::operator delete(pointer);
+    }
+
+private:
+    using block = std::aligned_storage_t<block_size, alignof(std::max_align_t)>;
+    std::array<block, block_count> storage_;
+    std::array<std::atomic<bool>, block_count> in_use_{};
+};
+
+template <class T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory_(&memory) {}
+
+    template <class U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory_(other.memory_) {}
+
+    T* allocate(std::size_t n) const {
+        return static_cast<T*>(memory_->allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* pointer, std::size_t) const {
+        memory_->deallocate(pointer);
+    }
+
+    bool operator==(const HandlerAllocator& other) const noexcept { return memory_ == other.memory_; }
+    bool operator!=(const HandlerAllocator& other) const noexcept { return memory_ != other.memory_; }
+
+private:
+    template <class> friend class HandlerAllocator;
+    HandlerMemory* memory_;
+};
+
+/**
+ * 把HandlerMemory作为关联分配器附加到completion handler上。
+ */
+template <class Handler>
+class AllocHandler {
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    AllocHandler(HandlerMemory& memory, Handler handler)
+        : memory_(memory), handler_(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept { return allocator_type(memory_); }
+
+    template <class... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+    const Handler& handler() const noexcept { return handler_; }
+
+private:
+    HandlerMemory& memory_;
+    Handler handler_;
+};
+
+template <class Handler>
+AllocHandler<std::decay_t<Handler>> make_alloc_handler(HandlerMemory& memory, Handler&& handler) {
+    return AllocHandler<std::decay_t<Handler>>(memory, std::forward<Handler>(handler));
+}
+
+/**
+ * 把HandlerMemory附加到任意completion token上(例如协程的use_awaitable)，
+ * 由token生成的handler被包装为AllocHandler。
+ */
+template <class Token>
+struct HandlerMemoryToken {
+    HandlerMemory& memory;
+    Token token;
+};
+
+template <class Token>
+HandlerMemoryToken<std::decay_t<Token>> use_handler_memory(HandlerMemory& memory, Token&& token) {
+    return {memory, std::forward<Token>(token)};
+}
+
+} // namespace repeater
+
+namespace boost::asio {
+
+// 包装后的handler仍在原handler的executor上完成(协程需要在自己的strand上恢复)
+template <class Handler, class Executor>
+struct associated_executor<repeater::AllocHandler<Handler>, Executor> {
+    using type = associated_executor_t<Handler, Executor>;
+
+    static type get(const repeater::AllocHandler<Handler>& h, const Executor& ex = Executor()) noexcept {
+        return associated_executor<Handler, Executor>::get(h.handler(), ex);
+    }
+};
+
+template <class Token, class Signature>
+struct async_result<repeater::HandlerMemoryToken<Token>, Signature> {
+    using return_type = typename async_result<Token, Signature>::return_type;
+
+    template <class Initiation>
+    struct init_wrapper {
+        repeater::HandlerMemory& memory;
+        Initiation initiation;
+
+        template <class Handler, class... Args>
+        void operator()(Handler&& handler, Args&&... args) {
+            std::move(initiation)(repeater::make_alloc_handler(memory, std::forward<Handler>(handler)),
+                                  std::forward<Args>(args)...);
+        }
+    };
+
+    template <class Initiation, class RawToken, class... Args>
+    static return_type initiate(Initiation&& initiation, RawToken&& token, Args&&... args) {
+        return async_initiate<Token, Signature>(
+            init_wrapper<std::decay_t<Initiation>>{token.memory, std::forward<Initiation>(initiation)},
+            token.token, std::forward<Args>(args)...);
+    }
+};
+
+} // namespace boost::asio
+
+#endif // REPEATER_HANDLER_MEMORY_HPP
@@ -0,0 +1,123 @@
+#ifndef REPEATER_JSON_SCAN_HPP
+#define REPEATER_JSON_SCAN_HPP
+
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace repeater::json_scan {
+
+/**
+ * 热路径上使用的零分配JSON字段扫描。
+ *
+ * OKX推送的是紧凑的JSON，我们只需要其中少数几个字段(arg.channel、data[0].seqId等)，
+ * 没必要为每条消息构建完整的DOM。这里的函数直接在原始报文上查找 "key": 并返回值的原始片段，
+ * 不做任何堆分配。它不是通用的JSON解析器：不处理转义后的key，也不校验文档的合法性。
+ */
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ * @brief 从pos(指向值的第一个字符)开始，返回该值的原始片段。
+ * 字符串返回去掉引号后的内容；对象/数组返回包含括号的完整片段；数字和字面量原样返回。
+ */
+inline std::string_view value_at(std::string_view json, std::size_t pos) {
+    if (pos >= json.size()) return {};
+
+    const char first = json[pos];
+    if (first == '"') {
+        std::size_t i = pos + 1;
+        while (i < json.size()) {
+            if (json[i] == '\\') { i += 2; continue; }
+            if (json[i] == '"') return json.substr(pos + 1, i - pos - 1);
+            ++i;
+        }
+        return {};
+    }
+
+    if (first == '{' || first == '[') {
+        int depth = 0;
+        bool in_string = false;
+        for (std::size_t i = pos; i < json.size(); ++i) {
+            const char c = json[i];
+            if (in_string) {
+                if (c == '\\') ++i;
+                else if (c == '"') in_string = false;
+                continue;
+            }
+            if (c == '"') in_string = true;
+            else if (c == '{' || c == '[') ++depth;
+            else if ((c == '}' || c == ']') && --depth == 0) return json.substr(pos, i - pos + 1);
+        }
+        return {};
+    }
+
+    std::size_t end = pos;
+    while (end < json.size() && json[end] != ',' && json[end] != '}' && json[end] != ']' && !is_space(json[end])) {
+        ++end;
+    }
+    return json.substr(pos, end - pos);
+}
+
+/**
+ * @brief 查找第一个名为key的字段并返回其值的原始片段，找不到时返回空。
+ */
+inline std::string_view find_field(std::string_view json, std::string_view key) {
+    std::size_t from = 0;
+    while (true) {
+        auto pos = json.find(key, from);
+        if (pos == std::string_view::npos) return {};
+        from = pos + key.size();
+
+        // key前后必须是引号，且后面紧跟冒号，才是一个字段名而不是某个值的一部分
+        if (pos == 0 || json[pos - 1] != '"' || from >= json.size() || json[from] != '"') continue;
+        std::size_t i = from + 1;
+        while (i < json.size() && is_space(json[i])) ++i;
+        if (i >= json.size() || json[i] != ':') continue;
+        ++i;
+        while (i < json.size() && is_space(json[i])) ++i;
+        return value_at(json, i);
+    }
+}
+
+/**
+ * @brief 返回数组片段(包含方括号)中第一个元素的原始片段。
+ */
+inline std::string_view first_element(std::string_view array) {
+    if (array.size() < 2 || array.front() != '[') return {};
+    std::size_t i = 1;
+    while (i < array.size() && is_space(array[i])) ++i;
+    if (i >= array.size() || array[i] == ']') return {};
+    return value_at(array, i);
+}
+
+/**
+ * @brief 返回数组片段中紧跟在element(由first_element/next_element返回的片段)之后的元素，没有更多元素时返回空。
+ */
+inline std::string_view next_element(std::string_view array, std::string_view element) {
+    auto i = static_cast<std::size_t>(element.data() + element.size() - array.data());
+    if (i < array.size() && array[i] == '"') ++i;  // 字符串元素的结尾引号
+    while (i < array.size() && is_space(array[i])) ++i;
+    if (i >= array.size() || array[i] != ',') return {};
+    ++i;
+    while (i < array.size() && is_space(array[i])) ++i;
+    if (i >= array.size() || array[i] == ']') return {};
+    return value_at(array, i);
+}
+
+/**
+ * @brief 将数字片段解析为int64。OKX的部分数字字段(如ts、tradeId)以字符串形式下发，这里同样适用。
+ */
+inline std::optional<int64_t> to_int64(std::string_view token) {
+    int64_t value = 0;
+    auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (ec != std::errc() || ptr != token.data() + token.size()) return std::nullopt;
+    return value;
+}
+
+} // namespace repeater::json_scan
+
+#endif // REPEATER_JSON_SCAN_HPP
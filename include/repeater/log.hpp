@@ -0,0 +1,223 @@
+#ifndef REPEATER_LOG_HPP
+#define REPEATER_LOG_HPP
+
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace repeater::log {
+
+/**
+ * 异步二进制日志。
+ *
+ * 调用线程只把时间戳、调用点指针和参数的二进制值写入自己的无锁环形队列(单生产者单消费者)，
+ * 格式化、加锁和写文件都由后台线程完成，热路径上没有系统调用，也不与其它线程竞争同一把锁。
+ * 队列满时丢弃并计数，不阻塞调用线程；每个调用点每秒最多记录rate_limit条，超出的条数附在下一条上。
+ * 未调用configure()时(例如测试工具)退化为在调用线程上同步格式化并写出。
+ *
+ * 格式串中的每个 "{}" 依次替换为一个参数，支持整数、浮点数、bool、字符和字符串。
+ */
+enum class Level : std::uint8_t {
+    debug = 0,
+    info,
+    warn,
+    error,
+    off
+};
+
+const char* to_string(Level level);
+
+struct Options {
+    Level level = Level::info;
+    std::string file;                 // 为空时info及以下写stdout，warn及以上写stderr
+    std::size_t queue_size = 2048;    // 每个线程的记录数，向上取整为2的幂
+    std::uint32_t rate_limit = 1000;  // 每个调用点每秒的记录数上限，0表示不限制
+    int poll_ms = 5;                  // 后台线程检查队列的间隔
+
+    /**
+     * @param debug 顶层 "debug" 配置，没有指定level时 true 对应debug级别
+     */
+    static Options from_json(const nlohmann::json& config, bool debug);
+};
+
+/**
+ * @brief 启动后台格式化线程，应在其它线程启动之前调用。
+ */
+void configure(const Options& options);
+
+/**
+ * @brief 写出所有队列中剩余的记录并停止后台线程，之后的记录同步写出。
+ * 不等待仍在写日志的线程：在停止时已经取得队列槽位、最后一次写出之后才提交的记录会丢失，
+ * 因此应在其它线程都已退出之后调用(RepeaterCore在join所有I/O线程之后调用)。
+ */
+void shutdown();
+
+/**
+ * @brief 因队列已满而丢弃的记录总数。
+ */
+std::uint64_t dropped();
+
+/**
+ * 一个日志调用点，由REPEATER_LOG宏定义为静态对象。
+ */
+struct Site {
+    Level level;
+    const char* format;
+    std::atomic<std::int64_t> second{-1};
+    std::atomic<std::uint32_t> count{0};
+    std::atomic<std::uint32_t> suppressed{0};
+
+    Site(Level l, const char* f) : level(l), format(f) {}
+};
+
+namespace detail {
+
+constexpr std::size_t record_size = 256;
+
+enum class ArgType : std::uint8_t { i64, u64, f64, boolean, character, string };
+
+struct RecordHeader {
+    std::int64_t time_ns;      // system_clock
+    const Site* site;
+    std::uint32_t suppressed;  // 这条记录之前被限速丢弃的条数
+    std::uint16_t size;        // args中已使用的字节数
+};
+
+struct Record {
+    RecordHeader header;
+    char args[record_size - sizeof(RecordHeader)];
+};
+
+struct Queue {
+    std::unique_ptr<Record[]> records;
+    std::size_t mask = 0;
+    alignas(64) std::atomic<std::uint64_t> head{0};  // 生产者写入
+    alignas(64) std::atomic<std::uint64_t> tail{0};  // 后台线程读取
+    std::atomic<bool> attached{true};                // 所属线程已退出后可被新线程复用
+};
+
+extern std::atomic<Level> level;
+extern std::uint32_t rate_limit;
+
+Record* acquire(std::int64_t time_ns);
+void commit(Record* record);
+
+inline std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief 按调用点限速，返回false表示这一条被丢弃。计数是近似的，跨秒边界时可能多放过几条。
+ */
+inline bool admit(Site& site, std::int64_t time_ns) {
+    if (rate_limit == 0) return true;
+    auto const second = time_ns / 1000000000;
+    auto seen = site.second.load(std::memory_order_relaxed);
+    if (seen != second && site.second.compare_exchange_strong(seen, second, std::memory_order_relaxed)) {
+        site.count.store(0, std::memory_order_relaxed);
+    }
+    if (site.count.fetch_add(1, std::memory_order_relaxed) < rate_limit) return true;
+    site.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+class Encoder {
+public:
+    explicit Encoder(Record* record) : record_(record) {}
+
+    template <typename T>
+    void put(const T& value) {
+        using U = std::decay_t<T>;
+        if constexpr (std::is_same_v<U, bool>) {
+            put_raw(ArgType::boolean, &value, sizeof(value));
+        } else if constexpr (std::is_same_v<U, char>) {
+            put_raw(ArgType::character, &value, sizeof(value));
+        } else if constexpr (std::is_enum_v<U>) {
+            put(static_cast<std::underlying_type_t<U>>(value));
+        } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+            std::int64_t const v = value;
+            put_raw(ArgType::i64, &v, sizeof(v));
+        } else if constexpr (std::is_integral_v<U>) {
+            std::uint64_t const v = value;
+            put_raw(ArgType::u64, &v, sizeof(v));
+        } else if constexpr (std::is_floating_point_v<U>) {
+            double const v = value;
+            put_raw(ArgType::f64, &v, sizeof(v));
+        } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            put_string(value);
+        } else {
+            // boost::string_view等有data()/size()的字符串类型
+            put_string(std::string_view(value.data(), value.size()));
+        }
+    }
+
+private:
+    void put_raw(ArgType type, const void* data, std::size_t size) {
+        auto& used = record_->header.size;
+        if (used + 1 + size > sizeof(record_->args)) return;
+        record_->args[used] = static_cast<char>(type);
+        std::memcpy(record_->args + used + 1, data, size);
+        used = static_cast<std::uint16_t>(used + 1 + size);
+    }
+
+    // 长度放在两个字节中；记录剩余空间不够时截断
+    void put_string(std::string_view value) {
+        auto& used = record_->header.size;
+        if (std::size_t{used} + 3 > sizeof(record_->args)) return;
+        auto const length = std::min(value.size(), sizeof(record_->args) - used - 3);
+        record_->args[used] = static_cast<char>(ArgType::string);
+        auto const length16 = static_cast<std::uint16_t>(length);
+        std::memcpy(record_->args + used + 1, &length16, sizeof(length16));
+        std::memcpy(record_->args + used + 3, value.data(), length);
+        used = static_cast<std::uint16_t>(used + 3 + length);
+    }
+
+    Record* record_;
+};
+
+template <typename... Args>
+void write(Site& site, const Args&... args) {
+    auto const time_ns = now_ns();
+    if (!admit(site, time_ns)) return;
+    auto* record = acquire(time_ns);
+    if (!record) return;
+    record->header.site = &site;
+    // 没有被限速的记录时suppressed只读不写。admit()中的count在限速开启时每次都会递增，
+    // 多个线程频繁写同一个调用点时，它所在的缓存行仍会在线程之间来回
+    record->header.suppressed = site.suppressed.load(std::memory_order_relaxed)
+                                    ? site.suppressed.exchange(0, std::memory_order_relaxed) : 0;
+    Encoder encoder(record);
+    (encoder.put(args), ...);
+    commit(record);
+}
+
+} // namespace detail
+
+inline bool enabled(Level l) {
+    return l >= detail::level.load(std::memory_order_relaxed);
+}
+
+} // namespace repeater::log
+
+/**
+ * 记录一条日志。级别低于当前配置时参数不会被求值。
+ *   REPEATER_LOG(debug, "[Processor] Forwarding {} from source {}", key, source_id);
+ */
+#define REPEATER_LOG(lvl, fmt, ...)                                                                    \
+    do {                                                                                               \
+        if (::repeater::log::enabled(::repeater::log::Level::lvl)) {                                   \
+            static ::repeater::log::Site repeater_log_site_(::repeater::log::Level::lvl, fmt);         \
+            ::repeater::log::detail::write(repeater_log_site_ __VA_OPT__(, ) __VA_ARGS__);             \
+        }                                                                                              \
+    } while (0)
+
+#endif // REPEATER_LOG_HPP
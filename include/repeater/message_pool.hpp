@@ -0,0 +1,129 @@
+#ifndef REPEATER_MESSAGE_POOL_HPP
+#define REPEATER_MESSAGE_POOL_HPP
+
+#include "repeater/runtime_profile.hpp"
+#include "repeater/ws_frame.hpp"
+#include <boost/smart_ptr/intrusive_ptr.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+namespace repeater {
+
+class MessagePool;
+
+/**
+ * 固定容量、带侵入式引用计数的消息缓冲区。
+ *
+ * 由MessagePool分配，最后一个引用释放时自动归还到池中，不经过堆分配器。
+ * 广播时所有下游会话共享同一个缓冲区。payload前预留了ws_frame::max_header_size字节，
+ * acquire时把服务端帧头紧贴payload写入，frame()即可直接作为一个iovec发送。
+ */
+class MessageBuffer {
+public:
+    char* data() { return storage_; }
+    const char* data() const { return storage_; }
+    std::size_t size() const { return size_; }
+    std::size_t capacity() const { return capacity_; }
+    std::string_view view() const { return {storage_, size_}; }
+    std::string_view frame() const { return {storage_ - header_size_, header_size_ + size_}; }
+
+    // 放入池时所在上游消息的trace id与读完成时间戳(见trace.hpp)，未跟踪时为0
+    std::uint64_t trace_id() const { return trace_id_; }
+    std::uint64_t trace_start() const { return trace_start_; }
+
+    // 所属的池，池耗尽时的堆上后备缓冲区为空
+    MessagePool* pool() const { return pool_; }
+
+    MessageBuffer(const MessageBuffer&) = delete;
+    MessageBuffer& operator=(const MessageBuffer&) = delete;
+
+private:
+    friend class MessagePool;
+    friend void intrusive_ptr_add_ref(MessageBuffer* b) noexcept;
+    friend void intrusive_ptr_release(MessageBuffer* b) noexcept;
+
+    MessageBuffer() = default;
+
+    std::atomic<std::uint32_t> refs_{0};
+    MessagePool* pool_ = nullptr;   // 为空表示池耗尽时的堆上后备缓冲区
+    MessageBuffer* next_free_ = nullptr;
+    char* storage_ = nullptr;
+    std::size_t capacity_ = 0;
+    std::size_t size_ = 0;
+    std::size_t header_size_ = 0;
+    std::uint64_t trace_id_ = 0;
+    std::uint64_t trace_start_ = 0;
+};
+
+using MessagePtr = boost::intrusive_ptr<MessageBuffer>;
+
+/**
+ * 线程安全的固定大小消息缓冲区池(slab)。
+ *
+ * 所有槽位在构造时一次性从一整块内存(slab)中切出，之后的acquire/release只是
+ * 在空闲链表上摘取和归还，稳态下每条消息不产生任何堆分配。
+ * 消息大于槽位大小或池耗尽时退化为堆分配，并计入overflow计数。
+ */
+class MessagePool {
+public:
+    /**
+     * @param profile 决定slab是否使用大页、是否在构造时预先写入(见runtime_profile.hpp)
+     */
+    MessagePool(std::size_t slot_size, std::size_t slot_count, const RuntimeProfile& profile = {});
+    ~MessagePool();
+
+    MessagePool(const MessagePool&) = delete;
+    MessagePool& operator=(const MessagePool&) = delete;
+
+    /**
+     * @brief 获取一个缓冲区并拷贝payload进去，同时写好opcode对应的帧头。
+     * @param compressed payload是permessage-deflate压缩后的内容，帧头置RSV1
+     */
+    MessagePtr acquire(std::string_view payload, ws_frame::Opcode opcode = ws_frame::Opcode::text,
+                       bool compressed = false);
+
+    std::size_t slot_size() const { return slot_size_; }
+    std::size_t slot_count() const { return slot_count_; }
+    std::size_t in_use() const { return in_use_.load(std::memory_order_relaxed); }
+    std::uint64_t overflow_count() const { return overflow_count_.load(std::memory_order_relaxed); }
+
+private:
+    friend void intrusive_ptr_release(MessageBuffer* b) noexcept;
+
+    void release(MessageBuffer* buffer) noexcept;
+
+    std::size_t slot_size_;
+    std::size_t slot_count_;
+    HotRegion slab_;
+    std::unique_ptr<MessageBuffer[]> slots_;
+
+    std::mutex mutex_;
+    MessageBuffer* free_list_ = nullptr;
+
+    std::atomic<std::size_t> in_use_{0};
+    std::atomic<std::uint64_t> overflow_count_{0};
+};
+
+inline void intrusive_ptr_add_ref(MessageBuffer* b) noexcept {
+    b->refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void intrusive_ptr_release(MessageBuffer* b) noexcept {
+    if (b->refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (b->pool_) {
+        b->pool_->release(b);
+    } else {
+        delete[] (b->storage_ - ws_frame::max_header_size);
+        delete b;
+    }
+}
+
+} // namespace repeater
+
+#endif // REPEATER_MESSAGE_POOL_HPP
@@ -1,33 +1,123 @@
 #ifndef REPEATER_MESSAGE_PROCESSOR_HPP
 #define REPEATER_MESSAGE_PROCESSOR_HPP
 
+#include "repeater/clock_offset.hpp"
+#include "repeater/dedup_policy.hpp"
+#include "nlohmann/json.hpp"
 #include <string>
 #include <string_view>
 #include <mutex>
+#include <shared_mutex>
 #include <functional>
+#include <memory>
+#include <unordered_map>
+#include <array>
+#include <atomic>
 #include <cstdint>
 
 namespace repeater {
 
 /**
- * 线程安全的消息处理器，它转发seqId最新的消息
- * 当收到一个具有新`seqId`的消息时，它会调用一个回调函数来转发该消息。
- * !!! 注意：它只转发seqId最新的消息，如果有更旧的消息更晚到达，则会被丢弃。
+ * 一条赢得竞争、需要向下游转发的消息。payload是上游收到的原始消息，payload和local_payload只在转发回调期间有效。
+ */
+struct ForwardedMessage {
+    std::string_view payload;
+    std::string_view channel;
+    std::string_view inst_id;
+    int64_t key;     // 去重策略使用的key(seqId/tradeId/ts)
+    int source_id;   // 赢得竞争的来源(上游连接或联邦对端)
+    std::size_t stream_index;  // 流的序号，从0开始按创建顺序分配，流存在期间不变
+    std::int64_t age_us;       // 比同一时期最快路径晚到的微秒数(见ClockOffsetEstimator)，消息没有ts时为-1
+    std::string_view local_payload;  // 发给本节点下游会话的内容：被标记为过时的消息带有stale字段，否则与payload相同
+};
+
+/**
+ * 线程安全的消息处理器，它只转发每条消息的首次到达
+ *
+ * 每个(channel, instId)是一个独立的流，拥有自己的锁和去重策略(见dedup_policy.hpp)：
+ * 订单簿类频道使用seqId水位线，成交类频道使用tradeId窗口，行情快照类频道使用(ts, 内容哈希)。
+ * 策略默认由channel决定，可通过配置文件中的 "dedup_policies" 按channel覆盖。
+ * 每条消息都带有来源id(上游连接或联邦对端)，处理器按来源统计赢得竞争的次数。
+ * 带ts的消息同时用于估计本地时钟与交易所时钟的偏差；配置了stale_guard时，
+ * 年龄超过上限的首次到达消息被丢弃或标记。
+ * !!! 注意：seqId策略只转发seqId最新的消息，如果有更旧的消息更晚到达，则会被丢弃。
  * 它适用于Market Data的场景
  */
 class MessageProcessor {
 public:
-    MessageProcessor(std::function<void(std::string_view)> forward_callback, bool debug);
+    using DedupOverrides = std::unordered_map<std::string, DedupKind>;
+
+    using ForwardCallback = std::function<void(const ForwardedMessage&)>;
+
+    static constexpr int max_sources = 64;
+
+    /**
+     * @param stale_guard 过时数据保护及时钟偏差估计的窗口。它在构造时固定，处理消息的线程读取时不需要同步
+     */
+    MessageProcessor(ForwardCallback forward_callback, bool debug, DedupOverrides overrides = {},
+                     StaleGuardOptions stale_guard = {});
+    ~MessageProcessor();
+
+    /**
+     * @brief 从配置的 "dedup_policies" 对象({"channel": "seq_id" | "trade_id" | "snapshot" | "pass_through"})解析覆盖表。
+     * @throws std::invalid_argument 策略名称无法识别时抛出。
+     */
+    static DedupOverrides parse_overrides(const nlohmann::json& config);
+
+    /**
+     * @brief 按订阅参数(OKX subscribe消息的args数组)预先创建流，并打印每个流选用的策略。
+     * 未预先创建的流会在第一条消息到达时按channel自动创建。
+     */
+    void register_subscriptions(const nlohmann::json& args);
 
-    void process(std::string_view message);
+    /**
+     * @param source_id 消息来源，取值范围 [0, max_sources)，超出范围的来源不计入统计。
+     */
+    void process(std::string_view message, int source_id = 0);
+
+    /**
+     * @brief 某个来源赢得竞争(其消息被转发)的次数。
+     */
+    std::uint64_t wins(int source_id) const;
+
+    /**
+     * @brief 清零某个来源的胜出计数和单向延迟统计，在来源id分配给新的连接时调用。
+     */
+    void reset_source(int source_id);
+
+    const ClockOffsetEstimator& clock() const { return *clock_; }
+
+    /**
+     * @brief 因过时被丢弃或标记的消息数。
+     */
+    std::uint64_t stale_count() const { return stale_.load(std::memory_order_relaxed); }
 
 private:
-    int64_t max_seq_id_ = 0;
-    std::mutex mutex_;
-    std::function<void(std::string_view)> forward_callback_;
+    struct Stream;
+
+    struct KeyHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+
+    Stream& find_or_create(std::string_view channel, std::string_view inst_id);
+    DedupKind kind_for(std::string_view channel) const;
+
+    template <class Policy>
+    void process_with(Stream& stream, Policy& policy, std::string_view message,
+                      std::string_view data, std::string_view first, int source_id, std::int64_t age_us);
+
+    std::shared_mutex streams_mutex_;
+    std::unordered_map<std::string, std::unique_ptr<Stream>, KeyHash, std::equal_to<>> streams_;
+    DedupOverrides overrides_;
+    ForwardCallback forward_callback_;
     bool debug_;
+    std::array<std::atomic<std::uint64_t>, max_sources> wins_{};
+    const StaleGuardOptions stale_guard_;
+    const std::unique_ptr<ClockOffsetEstimator> clock_;
+    std::atomic<std::uint64_t> stale_{0};
 };
 
 } // namespace repeater
 
-#endif // REPEATER_MESSAGE_PROCESSOR_HPP
\ No newline at end of file
+#endif // REPEATER_MESSAGE_PROCESSOR_HPP
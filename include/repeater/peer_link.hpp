@@ -0,0 +1,148 @@
+#ifndef REPEATER_PEER_LINK_HPP
+#define REPEATER_PEER_LINK_HPP
+
+#include "repeater/handler_memory.hpp"
+#include "repeater/message_pool.hpp"
+#include "repeater/socket_profile.hpp"
+#include "repeater/strand_stream.hpp"
+#include <boost/asio/steady_timer.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+namespace repeater {
+
+class PeerConnection;
+
+/**
+ * repeater之间的联邦链路使用的二进制帧头。
+ *
+ * 每一帧 = 16字节帧头 + payload(原始的OKX JSON消息)，所有整数字段均为网络字节序：
+ *   magic(4) | version(2) | reserved(2) | origin_node(4) | length(4)
+ * 节点只转发自己的上游赢得的消息，从对端收到的消息不会再转发，因此每一帧都只经过一条链路，不需要跳数字段。
+ */
+struct PeerFrameHeader {
+    static constexpr std::uint32_t magic = 0x4f52504c; // "ORPL"
+    static constexpr std::uint16_t version = 2;
+    static constexpr std::size_t size = 16;
+    static constexpr std::uint32_t max_length = 1 << 20;
+
+    std::uint32_t origin_node = 0;
+    std::uint32_t length = 0;
+
+    void encode(std::array<unsigned char, size>& out) const;
+    /**
+     * @return magic或version不匹配、保留字段不为0、长度超限时返回false。
+     */
+    bool decode(const std::array<unsigned char, size>& in);
+};
+
+/**
+ * 向一个对端repeater转发本节点首次到达的消息。
+ *
+ * 断线期间的消息直接丢弃(过时的行情没有意义)，并每秒重连一次。
+ * publish()可从任意线程调用；突发期间排队的多帧合并为一次gather写。
+ * 待写的帧(收件箱加写队列)最多max_queue条，对端跟不上时丢弃新消息而不是无限堆积，不会长期占用消息池的槽位。
+ */
+class PeerSender : public std::enable_shared_from_this<PeerSender> {
+public:
+    PeerSender(net::io_context& ioc, std::string address, std::uint32_t node_id,
+               const SocketProfile& socket_profile, bool debug);
+
+    void run();
+    void publish(MessagePtr const& msg);
+
+    const std::string& address() const { return address_; }
+
+    /**
+     * @brief 因对端跟不上(待写的帧已满)而丢弃的消息数。
+     */
+    std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    void do_resolve();
+    void on_resolve(beast::error_code ec, tcp::resolver::results_type results);
+    void do_connect(beast::error_code last);
+    void on_connect(beast::error_code ec);
+    void on_drain();
+    void do_write();
+    void on_write(beast::error_code ec, std::size_t);
+    void fail(beast::error_code ec, char const* what);
+
+    static constexpr std::size_t max_queue = 1024;
+
+    std::string address_;
+    std::string host_;
+    std::string port_;
+    std::uint32_t node_id_;
+    SocketProfile socket_profile_;
+    bool debug_;
+
+    strand_socket socket_;
+    tcp::resolver resolver_;
+    tcp::resolver::results_type endpoints_;
+    tcp::resolver::results_type::const_iterator next_endpoint_;
+    net::steady_timer reconnect_timer_;
+    bool connected_ = false;
+    bool writing_ = false;
+
+    // 写队列与对应的帧头，仅在strand上访问
+    std::vector<MessagePtr> queue_;
+    std::vector<std::array<unsigned char, PeerFrameHeader::size>> headers_;
+    std::vector<net::const_buffer> buffers_;
+    std::size_t in_flight_ = 0;
+
+    std::mutex inbox_mutex_;
+    std::vector<MessagePtr> inbox_;
+    std::size_t queued_ = 0;  // queue_.size()，在strand上更新，publish()在inbox_mutex_下读取
+    bool drain_scheduled_ = false;
+    std::atomic<std::uint64_t> dropped_{0};
+
+    HandlerMemory write_memory_;
+};
+
+/**
+ * 接受对端repeater的联邦连接，把收到的每一帧交给sink作为一个额外的上游来源。
+ *
+ * 只接受配置中列出的对端节点(按origin_node映射到source id)，一条链路上的每一帧都必须来自建立链路的节点；
+ * 来自本节点自身的帧(环路)会被丢弃。每条连接持有监听端的引用，监听端在所有连接关闭之前不会析构。
+ */
+class PeerListener : public std::enable_shared_from_this<PeerListener> {
+public:
+    using Sink = std::function<void(std::string_view message, int source_id)>;
+
+    PeerListener(net::io_context& ioc, tcp::endpoint endpoint, std::uint32_t node_id,
+                 std::unordered_map<std::uint32_t, int> origin_sources, Sink sink,
+                 const SocketProfile& socket_profile, bool debug);
+
+    void run();
+
+private:
+    friend class PeerConnection;
+
+    void do_accept();
+    void on_accept(beast::error_code ec, strand_socket socket);
+
+    net::io_context& ioc_;
+    tcp::acceptor acceptor_;
+    std::uint32_t node_id_;
+    std::unordered_map<std::uint32_t, int> origin_sources_;
+    Sink sink_;
+    SocketProfile socket_profile_;
+    bool debug_;
+};
+
+} // namespace repeater
+
+#endif // REPEATER_PEER_LINK_HPP
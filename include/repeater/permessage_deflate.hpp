@@ -0,0 +1,48 @@
+#ifndef REPEATER_PERMESSAGE_DEFLATE_HPP
+#define REPEATER_PERMESSAGE_DEFLATE_HPP
+
+#include "nlohmann/json.hpp"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace repeater::permessage_deflate {
+
+/**
+ * 下游会话的permessage-deflate(RFC 7692)配置，对应 "repeater_server" 中的 "permessage_deflate" 对象。
+ *
+ * 服务端总是以no_context_takeover压缩：每条消息从空字典开始，压缩结果与会话无关，
+ * 因此一条转发消息只压缩一次，所有协商了压缩的会话共享同一个压缩帧。
+ */
+struct Options {
+    bool enabled = false;
+    int level = 6;               // zlib压缩级别 1-9
+    int window_bits = 15;        // 压缩窗口 9-15，客户端要求更小的server_max_window_bits时不为它启用压缩
+    int mem_level = 8;           // zlib内存级别 1-9
+    std::size_t min_size = 256;  // 小于该长度的消息不压缩，直接发送原帧
+
+    static Options from_json(const nlohmann::json& j);
+};
+
+/**
+ * @brief 根据升级请求的Sec-WebSocket-Extensions头选择一个可接受的permessage-deflate提议。
+ * @return 响应中Sec-WebSocket-Extensions头的值；没有可接受的提议或未启用时为空
+ */
+std::optional<std::string> negotiate(std::string_view offers, const Options& options);
+
+/**
+ * @brief 用当前线程的压缩器把payload压缩为一条消息的RSV1帧内容(已去掉结尾的 00 00 ff ff)。
+ * @return 压缩结果不比原文短时返回false，此时应发送原帧
+ */
+bool compress(std::string_view payload, const Options& options, std::string& out);
+
+/**
+ * @brief 解压客户端发来的一条压缩消息(已拼接好所有分片)。
+ * @return 数据损坏或解压后超过max_size时返回false
+ */
+bool decompress(std::string_view payload, std::size_t max_size, std::string& out);
+
+} // namespace repeater::permessage_deflate
+
+#endif // REPEATER_PERMESSAGE_DEFLATE_HPP
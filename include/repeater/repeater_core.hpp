@@ -2,7 +2,15 @@
 #define REPEATER_REPEATER_CORE_HPP
 
 #include "nlohmann/json.hpp"
+#include "repeater/control_server.hpp"
+#include "repeater/socket_profile.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ssl.hpp>
+#include <atomic>
+#include <map>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 
@@ -11,20 +19,31 @@ namespace repeater {
 class WebSocketClient;
 class WebSocketServer;
 class MessageProcessor;
+class MessagePool;
+class PeerSender;
+class SubscriptionManager;
+struct SessionResponse;
 
 /**
  * 项目的核心业务逻辑控制器。
  *
  * 负责初始化和管理所有的WebSocket客户端、服务器以及消息处理器。
  * 它还管理着用于所有异步操作的io_context和线程池。
+ * 上游订阅由SubscriptionManager按需管理：配置文件中的订阅始终保持，下游会话请求的订阅在最后一个会话离开后退订。
+ * 配置了 "control" 时，运行期间可通过本地HTTP接口增删上游连接、修改订阅和重新加载配置，
+ * 下游会话和去重状态不受影响。
+ * 上游连接按 "feeds" 分组(例如public、business和不同的品种组)，每组有自己的端点和订阅，
+ * 可以有专用的I/O线程和消息池；所有组共享同一个MessageProcessor和下游服务器。
  */
 class RepeaterCore {
 public:
     /**
      * @brief 构造函数。
      * @param config 从JSON文件加载的配置。
+     * @param config_path 配置文件路径，POST /reload 时重新读取。
      */
-    explicit RepeaterCore(const nlohmann::json& config);
+    explicit RepeaterCore(const nlohmann::json& config, std::string config_path = {});
+    ~RepeaterCore();
 
     /**
      * @brief 启动整个重复器系统。
@@ -32,10 +51,62 @@ public:
     void run();
 
 private:
+    /**
+     * 一组上游连接，对应 "feeds" 中的一项。没有 "feeds" 时顶层的okx_connections和subscription_message组成唯一的 "default" 组。
+     * threads大于0的组在自己的io_context上读上游并处理消息(线程可绑定到cpus)，配置了message_pool的组使用自己的池，
+     * 一组的突发不会占用其它组的线程和池中的槽位。
+     */
+    struct Feed {
+        std::string name;
+        std::vector<std::string> channels;     // 下游会话请求的这些channel由本组订阅，以'*'结尾表示前缀
+        int threads = 0;
+        std::vector<int> cpus;
+        std::unique_ptr<net::io_context> ioc;  // threads为0时为空，使用共享的io_context
+        MessagePool* pool = nullptr;
+        std::unique_ptr<SubscriptionManager> subscriptions;
+    };
+
+    /**
+     * @brief 选择提供某个arg的组：已固定该arg的组，其次是channels匹配的组，最后是第一个没有声明channels的组。
+     */
+    std::size_t feed_for(const nlohmann::json& arg) const;
+
+    ControlServer::Response handle_control(const ControlServer::Request& req);
+    SessionResponse handle_session_request(std::uint64_t session_id, std::string_view message);
+
+    // 以下函数要求调用方持有control_mutex_
+    nlohmann::json status();
+    int add_connection(const std::string& url, std::size_t feed);
+    bool remove_connection(int id);
+    nlohmann::json reload();
+    std::string wins_report();
+
     nlohmann::json config_;
+    std::string config_path_;
     bool debug_;
+
+    // 运行期组件，由run()创建。声明顺序保证：缓冲池最后析构，依赖io_context的组件先于io_context析构
+    std::unique_ptr<MessagePool> pool_;
+    std::vector<std::unique_ptr<MessagePool>> feed_pools_;
+    std::unique_ptr<net::io_context> ioc_;
+    std::vector<std::unique_ptr<net::io_context>> tier_iocs_;  // 有专用线程的会话层级各自的io_context
+    std::unique_ptr<net::ssl::context> ssl_ctx_;
+    std::vector<Feed> feeds_;
+    SocketProfile socket_profile_;
+    std::vector<std::string> tier_names_;
+    std::shared_ptr<WebSocketServer> server_;
+    std::shared_ptr<MessageProcessor> processor_;
+    std::vector<std::shared_ptr<PeerSender>> peers_;
+    std::vector<std::atomic<MessagePool*>> source_pools_;  // 每个来源的消息放入的池，在转发路径上读取
+
+    // 控制面状态
+    std::mutex control_mutex_;
+    std::map<int, std::shared_ptr<WebSocketClient>> clients_;
+    std::vector<std::string> source_names_;
+    std::vector<std::size_t> source_feeds_;
+    int lowest_peer_source_ = 0;
 };
 
 } // namespace repeater
 
-#endif // REPEATER_REPEATER_CORE_HPP
\ No newline at end of file
+#endif // REPEATER_REPEATER_CORE_HPP
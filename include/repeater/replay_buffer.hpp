@@ -0,0 +1,73 @@
+#ifndef REPEATER_REPLAY_BUFFER_HPP
+#define REPEATER_REPLAY_BUFFER_HPP
+
+#include "repeater/message_pool.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace repeater {
+
+/**
+ * 每个(channel, instId)最近转发过的消息，供断线重连的下游会话续传。
+ *
+ * 每个流一个固定深度的环形缓冲区，保存消息的MessagePtr(与广播共享同一个池化缓冲区)
+ * 和去重key(seqId/tradeId/ts)。自身不加锁：由WebSocketServer在广播锁内调用，
+ * 使记录、广播快照和会话加入三者的顺序一致。
+ * 注意每个环形缓冲区最多占用depth个MessagePool槽位。
+ */
+class ReplayBuffer {
+public:
+    struct Replayed {
+        std::uint64_t order;  // 在广播锁内分配的转发序号，同一个流内单调递增，用于合并多个流的续传
+        MessagePtr message;
+    };
+
+    struct Result {
+        std::size_t replayed = 0;
+        bool complete = false;  // 缓冲区覆盖了after之后的全部消息；否则客户端需要重新同步快照
+    };
+
+    explicit ReplayBuffer(std::size_t depth) : depth_(depth) {}
+
+    std::size_t depth() const { return depth_; }
+
+    /**
+     * @brief 记录一条已转发的消息。每个流第一次出现时分配其缓冲区，之后不再分配。
+     */
+    void append(std::size_t stream_index, std::string_view channel, std::string_view inst_id,
+                std::int64_t key, MessagePtr const& message);
+
+    /**
+     * @brief 把key大于after的消息追加到out。多个流的结果按order排序后即为当时的转发顺序。
+     */
+    Result collect(std::string_view channel, std::string_view inst_id, std::int64_t after,
+                   std::vector<Replayed>& out) const;
+
+private:
+    struct Entry {
+        std::int64_t key = 0;
+        std::uint64_t order = 0;
+        MessagePtr message;
+    };
+
+    struct Ring {
+        std::vector<Entry> entries;
+        std::size_t next = 0;       // entries已满时最旧元素的位置
+        bool wrapped = false;       // 是否已经丢弃过消息
+    };
+
+    std::size_t depth_;
+    std::uint64_t next_order_ = 0;
+    std::vector<std::unique_ptr<Ring>> rings_;  // 按流序号索引
+    std::map<std::pair<std::string, std::string>, Ring*> by_name_;
+};
+
+} // namespace repeater
+
+#endif // REPEATER_REPLAY_BUFFER_HPP
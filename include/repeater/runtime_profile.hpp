@@ -0,0 +1,92 @@
+#ifndef REPEATER_RUNTIME_PROFILE_HPP
+#define REPEATER_RUNTIME_PROFILE_HPP
+
+#include "nlohmann/json.hpp"
+#include <cstddef>
+#include <vector>
+
+namespace repeater {
+
+/**
+ * 启动时的低延迟运行配置，对应配置文件中的 "runtime_profile" 对象。
+ *
+ * 目标是在第一条真实消息到达之前就进入稳态：缺页、冷缓存和延迟分配都在启动阶段付清。
+ * 所有选项默认关闭；需要权限的操作(mlockall、显式大页)失败时只打印警告，不影响启动。
+ */
+struct RuntimeProfile {
+    bool lock_memory = false;            // mlockall(MCL_CURRENT | MCL_FUTURE)
+    bool huge_pages = false;             // 消息池和去重表使用大页(先尝试MAP_HUGETLB，再退化为透明大页)
+    bool prefault = false;               // 启动时写一遍消息池、去重表区域和I/O线程的栈
+    std::vector<int> io_cpus;            // I/O线程依次绑定的CPU，为空时不绑定
+    bool numa_local = false;             // 内存优先从io_cpus[0]所在的NUMA节点分配
+    std::size_t stack_prefault_kb = 256;
+    std::size_t dedup_arena_mb = 16;     // 去重表的预留区域，用完后退化为普通堆分配
+    std::size_t warmup_messages = 0;     // 每个I/O线程在开始服务之前处理的合成消息数，0表示不预热
+
+    static RuntimeProfile from_json(const nlohmann::json& j);
+};
+
+/**
+ * 一块匿名映射的内存。按profile使用大页并预先写入，析构时munmap。
+ */
+class HotRegion {
+public:
+    HotRegion() = default;
+    HotRegion(std::size_t bytes, const RuntimeProfile& profile, const char* what);
+    ~HotRegion();
+
+    HotRegion(HotRegion&& other) noexcept;
+    HotRegion& operator=(HotRegion&& other) noexcept;
+    HotRegion(const HotRegion&) = delete;
+    HotRegion& operator=(const HotRegion&) = delete;
+
+    char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+/**
+ * @brief 进程级设置：NUMA内存策略与mlockall。应在分配消息池之前、启动任何线程之前调用，
+ * 使之后的分配和线程都继承这些设置。
+ */
+void apply_process_profile(const RuntimeProfile& profile);
+
+/**
+ * @brief 在I/O线程进入事件循环之前调用：绑定CPU、预先写入栈、注册trace环形缓冲区。
+ * @param index 线程序号，按序号取io_cpus中的CPU(循环使用)
+ */
+void prepare_io_thread(const RuntimeProfile& profile, std::size_t index);
+
+/**
+ * @brief 为去重表等长期存在的热数据预留一块区域，必须在创建MessageProcessor之前调用。
+ */
+void configure_hot_arena(const RuntimeProfile& profile);
+
+/**
+ * 从预留区域按顺序分配；区域未配置或已用完时使用operator new。
+ * 这些对象随流一起存在到进程结束，预留区域内的释放不回收空间。
+ */
+void* hot_allocate(std::size_t bytes);
+void hot_deallocate(void* pointer) noexcept;
+
+/**
+ * 作用域内当前线程的hot_allocate不使用预留区域，直接使用operator new。
+ * 用于预热：预热时创建的流在预热结束后释放，预留区域内的释放不回收空间，不能让它们占用区域。
+ */
+class HotArenaBypass {
+public:
+    HotArenaBypass();
+    ~HotArenaBypass();
+    HotArenaBypass(const HotArenaBypass&) = delete;
+    HotArenaBypass& operator=(const HotArenaBypass&) = delete;
+
+private:
+    bool previous_;
+};
+
+} // namespace repeater
+
+#endif // REPEATER_RUNTIME_PROFILE_HPP
@@ -0,0 +1,79 @@
+#ifndef REPEATER_SOCKET_PROFILE_HPP
+#define REPEATER_SOCKET_PROFILE_HPP
+
+#include "nlohmann/json.hpp"
+#include <cstddef>
+#include <string>
+
+namespace repeater {
+
+/**
+ * 一组统一的socket调优参数，在连接(上游)和接受(下游)时应用到每个TCP socket上。
+ *
+ * 取值为0或-1的字段表示“保持内核默认值”，不会调用setsockopt。
+ * 对应配置文件中的 "socket_profile" 对象。
+ */
+struct SocketProfile {
+    bool tcp_nodelay = true;          // 关闭Nagle算法
+    bool tcp_quickack = false;        // 每次读完成后重新设置TCP_QUICKACK(内核会自动清除该标志)
+    int rcvbuf = 0;                   // SO_RCVBUF，字节
+    int sndbuf = 0;                   // SO_SNDBUF，字节
+    int busy_poll_us = 0;             // SO_BUSY_POLL，微秒
+    int ip_tos = -1;                  // IP_TOS
+    int priority = -1;                // SO_PRIORITY
+    std::size_t read_buffer_size = 0; // 上游Beast读缓冲区的预分配大小，字节
+
+    static SocketProfile from_json(const nlohmann::json& j);
+};
+
+/**
+ * 内核实际生效的socket参数(通过getsockopt读回)。
+ */
+struct SocketReport {
+    int tcp_nodelay = -1;
+    int rcvbuf = -1;
+    int sndbuf = -1;
+    int busy_poll_us = -1;
+    int ip_tos = -1;
+    int priority = -1;
+
+    std::string to_string() const;
+};
+
+/**
+ * @brief 将profile应用到一个socket句柄上(连接socket或监听socket均可)。
+ * 单个选项设置失败不会中断后续选项，失败信息以warn级别写入日志(见log.hpp)。
+ * @return 设置失败的选项个数。
+ */
+int apply_socket_profile(int native_handle, const SocketProfile& profile, const char* who);
+
+template <class Socket>
+int apply_socket_profile(Socket& socket, const SocketProfile& profile, const char* who) {
+    return apply_socket_profile(socket.native_handle(), profile, who);
+}
+
+/**
+ * @brief 读回socket上当前生效的参数。
+ */
+SocketReport query_socket(int native_handle);
+
+/**
+ * @brief 创建一个探测socket，应用profile并返回内核实际授予的参数，用于启动报告。
+ */
+SocketReport probe_socket_profile(const SocketProfile& profile);
+
+void rearm_quickack(int native_handle);
+
+/**
+ * @brief 在开启了tcp_quickack时重新设置TCP_QUICKACK，应在每次读完成后调用。
+ */
+template <class Socket>
+void rearm_quickack(Socket& socket, const SocketProfile& profile) {
+    if (profile.tcp_quickack) {
+        rearm_quickack(socket.native_handle());
+    }
+}
+
+} // namespace repeater
+
+#endif // REPEATER_SOCKET_PROFILE_HPP
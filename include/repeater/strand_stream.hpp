@@ -0,0 +1,23 @@
+#ifndef REPEATER_STRAND_STREAM_HPP
+#define REPEATER_STRAND_STREAM_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core/basic_stream.hpp>
+
+namespace repeater {
+
+/**
+ * 以具体的strand类型(而不是any_io_executor)作为executor的TCP流。
+ *
+ * any_io_executor的小对象缓冲区放不下strand，每次异步操作对executor做prefer/require时
+ * 都会在堆上拷贝一份；使用具体类型后这些拷贝都在栈上完成，读写热路径上不再产生分配。
+ */
+using strand_executor = boost::asio::strand<boost::asio::io_context::executor_type>;
+using strand_tcp_stream = boost::beast::basic_stream<boost::asio::ip::tcp, strand_executor>;
+using strand_socket = strand_tcp_stream::socket_type;
+
+} // namespace repeater
+
+#endif // REPEATER_STRAND_STREAM_HPP
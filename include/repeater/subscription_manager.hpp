@@ -0,0 +1,118 @@
+#ifndef REPEATER_SUBSCRIPTION_MANAGER_HPP
+#define REPEATER_SUBSCRIPTION_MANAGER_HPP
+
+#include "nlohmann/json.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace net = boost::asio;
+
+namespace repeater {
+
+/**
+ * 一次批量刷新产生的上游订阅变更。
+ */
+struct SubscriptionUpdate {
+    nlohmann::json subscribed = nlohmann::json::array();
+    nlohmann::json unsubscribed = nlohmann::json::array();
+    std::vector<std::string> ops;     // 要发给每条上游连接的op消息，多个arg合并在同一条消息中
+    std::vector<std::string> replay;  // 重连时发送的完整订阅消息，没有任何订阅时为空
+};
+
+/**
+ * 按需管理上游订阅的引用计数。
+ *
+ * 每个arg(去掉以'#'开头的注释字段后)是一个订阅单元，其引用来自两类持有者：
+ * 配置文件/控制接口固定(pin)的订阅，以及下游会话通过 {"op":"subscribe"} 请求的订阅。
+ * 引用从0变为1时订阅上游，最后一个持有者释放时退订。变更先累积batch_window，
+ * 再与上游当前的订阅集合比较后一次性发布，窗口内先退订又重新订阅的arg不会产生任何op。
+ * 除构造函数外的所有函数都可以从任意线程调用。
+ */
+class SubscriptionManager {
+public:
+    using Publish = std::function<void(const SubscriptionUpdate& update)>;
+
+    /**
+     * OKX单条op消息的长度上限是64KB，超过时拆分为多条。
+     */
+    static constexpr std::size_t max_op_bytes = 60 * 1024;
+
+    SubscriptionManager(net::io_context& ioc, std::chrono::milliseconds batch_window, Publish publish, bool debug);
+
+    /**
+     * @brief 固定/取消固定一组订阅，返回实际发生变化的arg。
+     * @throws std::invalid_argument arg不是带 "channel" 字段的对象
+     */
+    nlohmann::json pin(const nlohmann::json& args);
+    nlohmann::json unpin(const nlohmann::json& args);
+    nlohmann::json pinned() const;
+
+    /**
+     * @brief 两个arg去掉注释字段后是否相同。
+     */
+    static bool same_arg(const nlohmann::json& a, const nlohmann::json& b) { return key_of(a) == key_of(b); }
+
+    /**
+     * @throws std::invalid_argument arg不是带 "channel" 字段的对象
+     */
+    static void validate(const nlohmann::json& arg) { key_of(arg); }
+
+    /**
+     * @brief 记录owner(下游会话)对一组arg的引用。同一owner重复订阅同一arg只计一次。
+     * @throws std::invalid_argument arg不是带 "channel" 字段的对象
+     */
+    void acquire(std::uint64_t owner, const nlohmann::json& args);
+    void release(std::uint64_t owner, const nlohmann::json& args);
+    void release_all(std::uint64_t owner);
+
+    /**
+     * @brief 当前上游已订阅集合的完整订阅消息，新建的上游连接以此作为初始订阅。
+     */
+    std::vector<std::string> replay_messages() const;
+
+    /**
+     * @brief 每个arg的引用计数、是否固定以及是否已在上游订阅。
+     */
+    nlohmann::json status() const;
+
+private:
+    struct Entry {
+        nlohmann::json arg;
+        int refs = 0;
+        bool pinned = false;
+    };
+
+    static std::string key_of(const nlohmann::json& arg, nlohmann::json* normalized = nullptr);
+    static std::vector<std::string> make_ops(const char* op, const nlohmann::json& args);
+
+    void ref(const std::string& key, const nlohmann::json& arg);
+    void unref(const std::string& key);
+    void schedule_flush();
+    void flush();
+
+    net::strand<net::io_context::executor_type> strand_;
+    net::steady_timer timer_;
+    std::chrono::milliseconds batch_window_;
+    Publish publish_;
+    bool debug_;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Entry> entries_;                                     // 期望的订阅集合
+    std::map<std::string, nlohmann::json> upstream_;                           // 已发布到上游的订阅集合
+    std::unordered_map<std::uint64_t, std::set<std::string>> owners_;         // 每个会话持有的arg
+    bool flush_scheduled_ = false;
+};
+
+} // namespace repeater
+
+#endif // REPEATER_SUBSCRIPTION_MANAGER_HPP
@@ -0,0 +1,174 @@
+#ifndef REPEATER_TRACE_HPP
+#define REPEATER_TRACE_HPP
+
+#include "nlohmann/json.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace repeater::trace {
+
+/**
+ * 热路径上的逐消息跟踪。
+ *
+ * 每条上游消息在读完成时分配一个trace id，之后在以下位置打TSC时间戳：
+ * 提取字段完成、去重判定、进入每个下游会话的队列、写完成。时间戳写入每个线程自己的
+ * 无锁环形缓冲区(单生产者，覆盖最旧的记录)，可以通过控制接口按需导出，或在某条消息
+ * 从读到写完成超过阈值时自动导出；导出文件用trace_report离线生成分阶段的延迟分解。
+ */
+enum class Stage : std::uint8_t {
+    read = 0,  // 客户端读完一帧，detail为来源id
+    extract,   // 处理器提取arg/data字段完成
+    dedup,     // 去重判定，detail为1表示转发、0表示丢弃
+    enqueue,   // 放入下游会话的收件箱，detail为会话id
+    write,     // 下游会话写完成，detail为会话id
+    count
+};
+
+inline const char* to_string(Stage stage) {
+    switch (stage) {
+        case Stage::read: return "read";
+        case Stage::extract: return "extract";
+        case Stage::dedup: return "dedup";
+        case Stage::enqueue: return "enqueue";
+        case Stage::write: return "write";
+        default: return "unknown";
+    }
+}
+
+struct Record {
+    std::uint64_t tsc;
+    std::uint64_t id;
+    std::uint32_t detail;
+    Stage stage;
+};
+
+/**
+ * 导出文件的格式：DumpHeader之后紧跟record_count个Record。
+ */
+struct DumpHeader {
+    char magic[8];
+    double tsc_per_ns;
+    std::uint64_t record_count;
+};
+
+constexpr char dump_magic[8] = {'R', 'P', 'T', 'R', 'A', 'C', 'E', '1'};
+
+struct Options {
+    bool enabled = false;
+    std::size_t ring_size = 65536;   // 每个线程的记录数，向上取整为2的幂
+    std::uint64_t threshold_us = 0;  // 读到写完成超过该值时自动导出，0表示不自动导出
+    std::string dump_dir = ".";
+    int cooldown_sec = 10;           // 两次自动导出之间的最小间隔
+
+    static Options from_json(const nlohmann::json& config);
+};
+
+/**
+ * @brief 启用跟踪，必须在I/O线程启动之前调用。设置了阈值时启动一个后台线程负责自动导出，
+ * 热路径线程只负责唤醒它，不做文件I/O。
+ */
+void configure(const Options& options);
+
+/**
+ * @brief 停止自动导出线程，在I/O线程退出之后调用。
+ */
+void shutdown();
+
+/**
+ * @brief 把所有线程的环形缓冲区写入dump_dir下的新文件。
+ * @return 文件路径与写入的记录数
+ * @throws std::runtime_error 文件无法写入
+ */
+std::pair<std::string, std::size_t> dump(std::string_view reason);
+
+namespace detail {
+
+struct Ring {
+    std::unique_ptr<Record[]> records;
+    std::size_t mask = 0;
+    std::uint64_t id_prefix = 0;   // 线程序号放在id的高16位，id在线程之间不冲突
+    std::uint64_t next_id = 0;
+    std::atomic<std::uint64_t> head{0};
+};
+
+struct Current {
+    std::uint64_t id = 0;
+    std::uint64_t start = 0;
+};
+
+extern bool enabled;
+extern std::uint64_t threshold_tsc;
+
+Ring* register_ring();
+void trip();
+
+inline thread_local Ring* local_ring = nullptr;
+inline thread_local Current current;
+
+} // namespace detail
+
+inline std::uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+inline void record(Stage stage, std::uint64_t id, std::uint32_t detail, std::uint64_t tsc) {
+    auto* ring = detail::local_ring;
+    if (!ring) ring = detail::local_ring = detail::register_ring();
+    auto const head = ring->head.load(std::memory_order_relaxed);
+    ring->records[head & ring->mask] = Record{tsc, id, detail, stage};
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * @brief 一条上游消息读完成，为它分配trace id。之后同一线程上的stamp都归属于这条消息，直到end()。
+ */
+inline void begin(std::uint32_t source_id) {
+    if (!detail::enabled) return;
+    auto* ring = detail::local_ring;
+    if (!ring) ring = detail::local_ring = detail::register_ring();
+    auto const tsc = now();
+    detail::current = {ring->id_prefix | ++ring->next_id, tsc};
+    record(Stage::read, detail::current.id, source_id, tsc);
+}
+
+inline void end() { detail::current = {}; }
+
+/**
+ * @brief 为当前线程预先注册环形缓冲区，第一条消息不必在热路径上分配。
+ */
+inline void attach_thread() {
+    if (detail::enabled && !detail::local_ring) detail::local_ring = detail::register_ring();
+}
+
+inline std::uint64_t current_id() { return detail::current.id; }
+inline std::uint64_t current_start() { return detail::current.start; }
+
+inline void stamp(Stage stage, std::uint32_t detail_value = 0) {
+    if (detail::current.id) record(stage, detail::current.id, detail_value, now());
+}
+
+/**
+ * @brief 一条消息在某个会话上写完成；从读到写完成超过阈值时触发导出。
+ */
+inline void complete(std::uint64_t id, std::uint64_t start, std::uint32_t session_id, std::uint64_t tsc) {
+    record(Stage::write, id, session_id, tsc);
+    if (detail::threshold_tsc && tsc > start && tsc - start > detail::threshold_tsc) detail::trip();
+}
+
+} // namespace repeater::trace
+
+#endif // REPEATER_TRACE_HPP
@@ -4,10 +4,27 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/ssl.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include "repeater/handler_memory.hpp"
+#include "repeater/log.hpp"
+#include "repeater/socket_profile.hpp"
+#include "repeater/strand_stream.hpp"
+#include "repeater/trace.hpp"
+#include <chrono>
+#include <deque>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <memory>
-#include <functional>
+#include <utility>
 
 namespace beast = boost::beast;
 namespace http = beast::http;
@@ -19,51 +36,333 @@ using tcp = net::ip::tcp;
 namespace repeater {
 
 /**
- * 封装了连接到单个WebSocket服务器的所有逻辑。
+ * 客户端协程使用的awaitable与completion token，executor为具体的strand类型(见strand_stream.hpp)。
+ */
+template <class T>
+using strand_awaitable = net::awaitable<T, strand_executor>;
+inline constexpr net::use_awaitable_t<strand_executor> use_strand_awaitable{};
+
+/**
+ * 拆分后的 ws:// 或 wss:// URL。
+ */
+struct WebSocketUrl {
+    std::string host;
+    std::string port;
+    std::string path;
+
+    /**
+     * @return scheme不匹配或缺少host时返回std::nullopt。
+     */
+    static std::optional<WebSocketUrl> parse(std::string_view url, std::string_view scheme, std::string_view default_port);
+};
+
+/**
+ * wss:// 传输层：TCP之上的TLS。TCP连接建立后先完成TLS握手(含SNI)，再进行WebSocket握手。
+ */
+struct TlsTransport {
+    using stream_type = websocket::stream<beast::ssl_stream<strand_tcp_stream>>;
+    static constexpr std::string_view scheme = "wss://";
+    static constexpr std::string_view default_port = "443";
+    static constexpr const char* log_tag = "Client";
+    static constexpr const char* user_agent = " websocket-client-coro";
+
+    ssl::context& ctx;
+
+    void emplace(std::optional<stream_type>& ws, strand_executor const& ex) const { ws.emplace(ex, ctx); }
+
+    /**
+     * @return 失败时返回失败的步骤名，成功时返回nullptr。
+     */
+    strand_awaitable<const char*> handshake(stream_type& ws, std::string const& host, beast::error_code& ec) const;
+};
+
+/**
+ * ws:// 传输层：明文TCP，没有额外的握手。
+ */
+struct PlainTransport {
+    using stream_type = websocket::stream<strand_tcp_stream>;
+    static constexpr std::string_view scheme = "ws://";
+    static constexpr std::string_view default_port = "80";
+    static constexpr const char* log_tag = "Plain Client";
+    static constexpr const char* user_agent = " websocket-client-plain";
+
+    void emplace(std::optional<stream_type>& ws, strand_executor const& ex) const { ws.emplace(ex); }
+
+    strand_awaitable<const char*> handshake(stream_type&, std::string const&, beast::error_code&) const {
+        co_return nullptr;
+    }
+};
+
+/**
+ * 上游WebSocket连接的控制接口。
  *
- * 负责解析URL、建立TCP连接、进行SSL握手、WebSocket握手、发送订阅消息，
- * 并异步循环读取消息。它还实现了简单的自动重连逻辑。
+ * 只包含控制面的操作，读循环不经过这里的任何虚调用。
+ * 所有函数都可从任意线程调用，它们会被投递到连接的strand上执行。
  */
-class WebSocketClient : public std::enable_shared_from_this<WebSocketClient> {
+class WebSocketClient {
 public:
-    using OnMessageCallback = std::function<void(const std::string&)>;
+    virtual ~WebSocketClient() = default;
+
+    virtual void run() = 0;
 
-    WebSocketClient(
+    /**
+     * @brief 关闭连接并停止重连。
+     */
+    virtual void stop() = 0;
+
+    /**
+     * @brief 在当前连接上发送一条文本消息(例如增量的subscribe/unsubscribe)。未连接时丢弃。
+     */
+    virtual void send(std::string text) = 0;
+
+    /**
+     * @brief 替换每次(重新)连接后要发送的订阅消息，为空时不发送任何订阅。
+     */
+    virtual void set_subscription(std::vector<std::string> sub_msgs) = 0;
+
+    virtual int id() const = 0;
+    virtual const std::string& url() const = 0;
+};
+
+/**
+ * 连接到单个WebSocket服务器的客户端，以C++20协程实现。
+ *
+ * Transport决定流的类型(TlsTransport / PlainTransport)，Sink是接收每条消息的函数对象，
+ * 签名为 void(std::string_view)。Sink是模板参数而不是std::function，读循环中对它的调用可以内联；
+ * 读操作的状态放在每连接的HandlerMemory中，稳态下读循环没有类型擦除的调用，也不分配handler。
+ *
+ * 协程负责建立TCP连接、传输层握手、WebSocket握手、发送订阅消息并循环读取消息；
+ * 任何一步失败后等待5秒重建流并重连，重连后重新发送当前的订阅消息。
+ */
+template <class Transport, class Sink>
+class BasicWebSocketClient : public WebSocketClient,
+                             public std::enable_shared_from_this<BasicWebSocketClient<Transport, Sink>> {
+public:
+    BasicWebSocketClient(
         net::io_context& ioc,
-        ssl::context& ctx,
+        Transport transport,
         std::string url,
-        std::string sub_msg,
-        OnMessageCallback on_message_cb,
+        std::vector<std::string> sub_msgs,
+        Sink sink,
+        const SocketProfile& socket_profile,
         bool debug,
-        int id);
+        int id)
+        : id_(id),
+          transport_(std::move(transport)),
+          strand_(net::make_strand(ioc)),
+          resolver_(strand_),
+          reconnect_timer_(strand_),
+          writer_idle_(strand_),
+          url_str_(std::move(url)),
+          sub_msgs_(std::move(sub_msgs)),
+          sink_(std::move(sink)),
+          socket_profile_(socket_profile),
+          debug_(debug)
+    {
+        if (socket_profile_.read_buffer_size > 0) {
+            buffer_.reserve(socket_profile_.read_buffer_size);
+        }
+        if (debug_) {
+            REPEATER_LOG(debug, "[{} {}] Created for URL: {}", Transport::log_tag, id_, url_str_);
+        }
+    }
+
+    void run() override {
+        auto url = WebSocketUrl::parse(url_str_, Transport::scheme, Transport::default_port);
+        if (!url) {
+            REPEATER_LOG(error, "[{} {}] Invalid WebSocket URL, expected {} in: {}", Transport::log_tag, id_,
+                         Transport::scheme, url_str_);
+            return;
+        }
+        url_ = std::move(*url);
+        net::co_spawn(strand_, session(this->shared_from_this()), net::detached);
+    }
+
+    void stop() override {
+        net::post(strand_, [self = this->shared_from_this()] {
+            self->stopped_ = true;
+            self->open_ = false;
+            self->reconnect_timer_.cancel();
+            self->resolver_.cancel();
+            self->close_socket();
+            if (self->debug_) REPEATER_LOG(debug, "[{} {}] Stopped.", Transport::log_tag, self->id_);
+        });
+    }
+
+    void send(std::string text) override {
+        net::post(strand_, [self = this->shared_from_this(), text = std::move(text)]() mutable {
+            if (!self->open_) return; // 重连后会重新发送完整的订阅消息
+            self->write_queue_.push_back(std::move(text));
+            self->start_writer();
+        });
+    }
+
+    void set_subscription(std::vector<std::string> sub_msgs) override {
+        net::post(strand_, [self = this->shared_from_this(), sub_msgs = std::move(sub_msgs)]() mutable {
+            self->sub_msgs_ = std::move(sub_msgs);
+        });
+    }
 
-    void run();
+    int id() const override { return id_; }
+    const std::string& url() const override { return url_str_; }
 
 private:
-    void on_resolve(beast::error_code ec, tcp::resolver::results_type results);
-    void on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type);
-    void on_ssl_handshake(beast::error_code ec);
-    void on_handshake(beast::error_code ec);
-    void on_write(beast::error_code ec, std::size_t bytes_transferred);
-    void on_read(beast::error_code ec, std::size_t bytes_transferred);
-    void on_close(beast::error_code ec);
-    void fail(beast::error_code ec, char const* what);
-    void reconnect();
+    using stream_type = typename Transport::stream_type;
+
+    static strand_awaitable<void> session(std::shared_ptr<BasicWebSocketClient> self) {
+        while (!self->stopped_) {
+            beast::error_code ec;
+            char const* what = co_await self->connect_and_read(ec);
+            self->open_ = false;
+            self->close_socket();
+            co_await self->wait_writer_idle();
+            if (self->stopped_) break;
+
+            REPEATER_LOG(error, "[{} {}] Error in {}: {}", Transport::log_tag, self->id_, what, ec.message());
+            if (self->debug_) {
+                REPEATER_LOG(debug, "[{} {}] Attempting to reconnect in 5 seconds...", Transport::log_tag, self->id_);
+            }
+            self->reconnect_timer_.expires_after(std::chrono::seconds(5));
+            co_await self->reconnect_timer_.async_wait(net::redirect_error(use_strand_awaitable, ec));
+        }
+    }
+
+    /**
+     * @return 连接结束时失败的步骤名，ec为对应的错误。
+     */
+    strand_awaitable<char const*> connect_and_read(beast::error_code& ec) {
+        auto token = net::redirect_error(use_strand_awaitable, ec);
+
+        auto const results = co_await resolver_.async_resolve(url_.host, url_.port, token);
+        if (ec) co_return "resolve";
+
+        // 每次连接都重建流：失败或关闭过的SSL/WebSocket流不能复用
+        transport_.emplace(ws_, strand_);
+        auto& tcp_layer = beast::get_lowest_layer(*ws_);
+        tcp_layer.expires_after(std::chrono::seconds(30));
+        // 依次尝试每个地址，每次都先打开socket并应用profile再连接：窗口缩放因子在SYN中协商，
+        // 连接建立之后再增大SO_RCVBUF，超过64KB的部分基本不起作用
+        ec = net::error::host_not_found;
+        for (auto const& entry : results) {
+            auto& socket = tcp_layer.socket();
+            beast::error_code ignored;
+            socket.close(ignored);
+            socket.open(entry.endpoint().protocol(), ec);
+            if (ec) continue;
+            apply_socket_profile(socket, socket_profile_, Transport::log_tag);
+            co_await tcp_layer.async_connect(entry.endpoint(), token);
+            if (!ec) break;
+        }
+        if (ec) co_return "connect";
+
+        if (auto const step = co_await transport_.handshake(*ws_, url_.host, ec)) co_return step;
+
+        tcp_layer.expires_never();
+        ws_->set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+        ws_->set_option(websocket::stream_base::decorator(
+            [](websocket::request_type& req) {
+                req.set(http::field::user_agent, std::string(BOOST_BEAST_VERSION_STRING) + Transport::user_agent);
+            }));
+        co_await ws_->async_handshake(url_.host, url_.path, token);
+        if (ec) co_return "handshake";
+
+        if (debug_) REPEATER_LOG(debug, "[{} {}] Connected. Sending subscription.", Transport::log_tag, id_);
+
+        // 订阅消息走写队列，读循环立即开始，后续的增量订阅也复用同一个写队列
+        open_ = true;
+        write_queue_.assign(sub_msgs_.begin(), sub_msgs_.end());
+        start_writer();
+
+        // 读操作的op状态放在每连接的HandlerMemory中
+        auto read_token = use_handler_memory(read_memory_, token);
+        buffer_.consume(buffer_.size());
+        for (;;) {
+            co_await ws_->async_read(buffer_, read_token);
+            if (ec) co_return "read";
+            trace::begin(static_cast<std::uint32_t>(id_));
+            rearm_quickack(tcp_layer.socket(), socket_profile_);
+
+            // 直接把flat_buffer中的连续内存交给sink，不再为每条消息构造std::string
+            auto const data = buffer_.data();
+            sink_(std::string_view(static_cast<const char*>(data.data()), data.size()));
+            trace::end();
+            buffer_.consume(buffer_.size());
+        }
+    }
+
+    /**
+     * 等待写协程退出。关闭socket后挂起的async_write以operation_aborted完成，
+     * 在此之前不能重建ws_，否则写操作完成时访问的是已经销毁的流。
+     */
+    strand_awaitable<void> wait_writer_idle() {
+        while (writing_) {
+            beast::error_code ignored;
+            writer_idle_.expires_at(net::steady_timer::time_point::max());
+            co_await writer_idle_.async_wait(net::redirect_error(use_strand_awaitable, ignored));
+        }
+    }
+
+    void start_writer() {
+        if (writing_ || write_queue_.empty()) return;
+        writing_ = true;
+        net::co_spawn(strand_, write_loop(this->shared_from_this()), net::detached);
+    }
+
+    static strand_awaitable<void> write_loop(std::shared_ptr<BasicWebSocketClient> self) {
+        while (self->open_ && !self->write_queue_.empty()) {
+            beast::error_code ec;
+            self->ws_->text(true);
+            co_await self->ws_->async_write(net::buffer(self->write_queue_.front()),
+                                            net::redirect_error(use_strand_awaitable, ec));
+            // 写失败时读循环也会失败，由它负责重连
+            if (ec) break;
+            self->write_queue_.pop_front();
+        }
+        self->write_queue_.clear();
+        self->writing_ = false;
+        self->writer_idle_.cancel();
+    }
+
+    void close_socket() {
+        if (!ws_) return;
+        beast::error_code ignored;
+        beast::get_lowest_layer(*ws_).socket().close(ignored);
+    }
 
     int id_;
+    Transport transport_;
+    strand_executor strand_;
     tcp::resolver resolver_;
-    websocket::stream<beast::ssl_stream<beast::tcp_stream>> ws_;
+    net::steady_timer reconnect_timer_;
+    net::steady_timer writer_idle_;  // 写协程退出时取消，用来唤醒wait_writer_idle()
+    std::optional<stream_type> ws_;
     beast::flat_buffer buffer_;
+    HandlerMemory read_memory_;
     std::string url_str_;
-    std::string host_;
-    std::string port_;
-    std::string path_;
-    std::string sub_msg_;
-    OnMessageCallback on_message_cb_;
+    WebSocketUrl url_;
+    std::vector<std::string> sub_msgs_;
+    Sink sink_;
+    SocketProfile socket_profile_;
     bool debug_;
-    net::steady_timer reconnect_timer_;
+
+    std::deque<std::string> write_queue_;
+    bool open_ = false;
+    bool writing_ = false;
+    bool stopped_ = false;
 };
 
+/**
+ * @brief 创建客户端，Sink的类型由参数推导(可以直接传入lambda)。
+ */
+template <class Transport, class Sink>
+std::shared_ptr<BasicWebSocketClient<Transport, Sink>> make_websocket_client(
+    net::io_context& ioc, Transport transport, std::string url, std::vector<std::string> sub_msgs, Sink sink,
+    const SocketProfile& socket_profile, bool debug, int id)
+{
+    return std::make_shared<BasicWebSocketClient<Transport, Sink>>(
+        ioc, std::move(transport), std::move(url), std::move(sub_msgs), std::move(sink), socket_profile, debug, id);
+}
+
 } // namespace repeater
 
-#endif // REPEATER_WEBSOCKET_CLIENT_HPP
\ No newline at end of file
+#endif // REPEATER_WEBSOCKET_CLIENT_HPP
@@ -5,7 +5,17 @@
 #include <boost/beast/websocket.hpp>
 #include <boost/asio/dispatch.hpp>
 #include <boost/asio/strand.hpp>
+#include "repeater/message_pool.hpp"
+#include "repeater/message_processor.hpp"
+#include "repeater/permessage_deflate.hpp"
+#include "repeater/replay_buffer.hpp"
+#include "repeater/socket_profile.hpp"
+#include "repeater/strand_stream.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <vector>
 #include <mutex>
@@ -21,6 +31,39 @@ namespace repeater {
 
 class WebSocketSession;
 
+/**
+ * 下游会话订阅的一个流：channel必须相同；inst_id为空时匹配该channel的所有instId
+ * (例如按instType或instFamily订阅的arg)。
+ */
+struct StreamSelector {
+    std::string channel;
+    std::string inst_id;
+
+    bool matches(std::string_view stream_channel, std::string_view stream_inst_id) const {
+        return channel == stream_channel && (inst_id.empty() || inst_id == stream_inst_id);
+    }
+    bool operator==(const StreamSelector&) const = default;
+};
+
+/**
+ * 下游会话请求的处理结果。replies按顺序发回该会话；subscribed/unsubscribed是请求成功后
+ * 会话订阅集合的变化。会话第一次订阅之后只收到它订阅的流，在此之前收到所有转发的消息。
+ */
+struct SessionResponse {
+    std::vector<std::string> replies;
+    std::vector<StreamSelector> subscribed;
+    std::vector<StreamSelector> unsubscribed;
+};
+
+/**
+ * 下游会话的优先级层级。广播总是先投递给靠前的层级；设置了context的层级，
+ * 其会话在握手前移交给这个专用的io_context，读写不与其它层级共用线程。
+ */
+struct SessionTier {
+    std::string name;
+    net::io_context* context = nullptr;  // nullptr表示使用服务器的io_context
+};
+
 /**
  * 接受外部客户端连接，并向所有连接的客户端广播消息。
  *
@@ -28,25 +71,141 @@ class WebSocketSession;
  */
 class WebSocketServer : public std::enable_shared_from_this<WebSocketServer> {
 public:
-    WebSocketServer(net::io_context& ioc, tcp::endpoint endpoint, bool debug);
+    /**
+     * @param replay_depth 每个流保存的最近转发消息数，供重连的会话续传；0表示不保存
+     */
+    WebSocketServer(net::io_context& ioc, tcp::endpoint endpoint, const SocketProfile& socket_profile,
+                    MessagePool& pool, std::size_t replay_depth, bool debug);
 
     void run();
 
+    /**
+     * @brief 实际监听的地址；构造时端口为0则由系统分配。
+     */
+    tcp::endpoint local_endpoint() const;
+
     void broadcast(std::string_view message);
 
+    /**
+     * @brief 广播一个已经在池中的消息缓冲区，调用方可以把同一个缓冲区同时交给其它消费者(如联邦对端)。
+     */
+    void broadcast(MessagePtr const& message);
+
+    /**
+     * @brief 广播一条处理器转发的消息，并记入其所在流的续传缓冲区。订阅过的会话只在订阅了这个流时收到。
+     */
+    void broadcast(MessagePtr const& message, const ForwardedMessage& origin);
+
+    std::size_t session_count();
+
+    /**
+     * @brief 每个层级当前的会话数，顺序与set_tiers相同。
+     */
+    std::vector<std::size_t> tier_session_counts();
+
+    /**
+     * 处理下游会话发来的文本消息。
+     * session_id在进程内唯一；会话离开时以同一id调用SessionCloseHandler。
+     */
+    using SessionMessageHandler = std::function<SessionResponse(std::uint64_t session_id, std::string_view message)>;
+    using SessionCloseHandler = std::function<void(std::uint64_t session_id)>;
+
+    /**
+     * @brief 设置下游会话的消息与关闭回调，必须在run()之前调用。
+     */
+    void set_session_handlers(SessionMessageHandler on_message, SessionCloseHandler on_close);
+
+    /**
+     * @brief 设置优先级层级(优先级从高到低)，必须在run()之前调用。默认只有一个层级"default"。
+     *
+     * 会话在升级请求中用X-Repeater-Tier头或URL路径的第一段(如 ws://host:9002/execution)声明层级，
+     * 没有声明或名字不存在时归入default_tier。
+     */
+    void set_tiers(std::vector<SessionTier> tiers, std::size_t default_tier);
+
+    /**
+     * @brief 设置下游会话的permessage-deflate，必须在run()之前调用。默认不压缩。
+     *
+     * 广播的消息只压缩一次，所有协商了压缩的会话共享同一个压缩帧；未协商的会话收到的仍是原帧。
+     * 续传的消息和对请求的回复不压缩(RSV1为0的帧在压缩会话中同样合法)。
+     */
+    void set_compression(const permessage_deflate::Options& options);
+
+    struct CompressionStats {
+        std::size_t sessions = 0;    // 当前协商了压缩的会话数
+        std::uint64_t messages = 0;  // 生成的压缩帧数
+        std::uint64_t bytes_in = 0;  // 被压缩消息的原始长度之和
+        std::uint64_t bytes_out = 0; // 压缩后长度之和
+    };
+
+    CompressionStats compression_stats();
+
 private:
     void do_accept();
-    void on_accept(beast::error_code ec, tcp::socket socket);
+    void on_accept(beast::error_code ec, strand_socket socket);
+
+    struct ResumeRequest {
+        std::string channel;
+        std::string inst_id;
+        std::int64_t after;
+    };
+
+    /**
+     * @brief 解析升级请求target中的续传参数 "?resume=<channel>:<instId>:<key>,..."。
+     */
+    static std::vector<ResumeRequest> parse_resume_requests(std::string_view target);
 
-    void join(std::shared_ptr<WebSocketSession> session);
+    /**
+     * @brief 根据X-Repeater-Tier头或target的路径选出会话的层级序号。
+     */
+    std::size_t select_tier(std::string_view target, std::string_view header) const;
+
+    /**
+     * @brief 握手完成的会话加入广播，先按续传参数把错过的消息放进它的收件箱。
+     */
+    void join(std::shared_ptr<WebSocketSession> session, std::string_view target);
     void leave(std::shared_ptr<WebSocketSession> session);
+    void rebuild_snapshot();
+
+    using SessionList = std::vector<std::shared_ptr<WebSocketSession>>;
+
+    /**
+     * @brief 按快照顺序把消息投递给每个会话：先投递未压缩的会话，再生成共享的压缩帧投递给压缩会话。
+     * @param origin 消息所属的流，按会话的订阅过滤；nullptr表示投递给所有会话
+     */
+    void fan_out(const SessionList& sessions, MessagePtr const& message, const ForwardedMessage* origin);
+
+    /**
+     * @brief 生成消息的压缩帧；太短或压缩后不更短时返回空，调用方发送原帧。
+     */
+    MessagePtr compress(MessagePtr const& message);
+
+    void on_session_message(std::shared_ptr<WebSocketSession> session, std::string_view message);
 
     net::io_context& ioc_;
     tcp::acceptor acceptor_;
+    SocketProfile socket_profile_;
+    MessagePool& pool_;
     bool debug_;
+    ReplayBuffer replay_;  // 受sessions_mutex_保护
     
     std::mutex sessions_mutex_;
     std::unordered_set<std::shared_ptr<WebSocketSession>> sessions_;
+    // 会话集合的只读快照，仅在join/leave时重建，broadcast只需拷贝一次shared_ptr。
+    // 只包含握手已完成的会话，按(层级, 会话id)排序，投递顺序在每次广播中都相同
+    std::shared_ptr<const SessionList> snapshot_;
+
+    std::vector<SessionTier> tiers_;
+    std::size_t default_tier_ = 0;
+
+    permessage_deflate::Options compression_;
+    std::atomic<std::uint64_t> compressed_messages_{0};
+    std::atomic<std::uint64_t> compressed_in_bytes_{0};
+    std::atomic<std::uint64_t> compressed_out_bytes_{0};
+
+    std::atomic<std::uint64_t> next_session_id_{0};
+    SessionMessageHandler on_session_message_;
+    SessionCloseHandler on_session_close_;
 };
 
 } // namespace repeater
@@ -0,0 +1,138 @@
+#ifndef REPEATER_WS_FRAME_HPP
+#define REPEATER_WS_FRAME_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace repeater::ws_frame {
+
+/**
+ * 下游会话自己完成WebSocket(RFC 6455)分帧所需的最小实现。
+ *
+ * 服务端发出的帧不加掩码，同一条消息发给每个会话的字节完全相同，因此帧头只需在放入
+ * MessagePool时计算一次；客户端发来的帧必须带掩码，只有订阅请求、ping和close这类控制流量。
+ */
+enum class Opcode : std::uint8_t {
+    continuation = 0x0,
+    text = 0x1,
+    binary = 0x2,
+    close = 0x8,
+    ping = 0x9,
+    pong = 0xA
+};
+
+constexpr std::size_t max_header_size = 10;
+
+inline bool is_control(Opcode opcode) {
+    return (static_cast<std::uint8_t>(opcode) & 0x8) != 0;
+}
+
+/**
+ * @brief 写出服务端(无掩码)帧头。
+ * @return 帧头长度，2、4或10字节。
+ */
+inline std::size_t encode_header(unsigned char* out, Opcode opcode, std::size_t payload_size,
+                                 bool fin = true, bool rsv1 = false) {
+    out[0] = static_cast<unsigned char>((fin ? 0x80 : 0) | (rsv1 ? 0x40 : 0) | static_cast<std::uint8_t>(opcode));
+    if (payload_size < 126) {
+        out[1] = static_cast<unsigned char>(payload_size);
+        return 2;
+    }
+    if (payload_size <= 0xFFFF) {
+        out[1] = 126;
+        out[2] = static_cast<unsigned char>(payload_size >> 8);
+        out[3] = static_cast<unsigned char>(payload_size);
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; ++i) {
+        out[2 + i] = static_cast<unsigned char>(static_cast<std::uint64_t>(payload_size) >> (56 - 8 * i));
+    }
+    return 10;
+}
+
+struct Frame {
+    Opcode opcode = Opcode::text;
+    bool fin = true;
+    bool rsv1 = false;
+    std::string_view payload;
+};
+
+enum class ParseResult {
+    frame,           // 解析出一帧，consumed为整帧长度
+    need_more,       // 数据不完整
+    protocol_error,  // 未加掩码、保留位/操作码非法、长度未用最短编码、控制帧过长或分片
+    too_large        // payload超过max_payload
+};
+
+/**
+ * @brief 从data中解析一个客户端帧，并原地去掉payload的掩码。
+ */
+inline ParseResult parse_client_frame(char* data, std::size_t size, std::size_t max_payload,
+                                      Frame& frame, std::size_t& consumed) {
+    if (size < 2) return ParseResult::need_more;
+    auto const* bytes = reinterpret_cast<const unsigned char*>(data);
+    bool const fin = bytes[0] & 0x80;
+    bool const rsv1 = bytes[0] & 0x40;
+    auto const opcode = static_cast<Opcode>(bytes[0] & 0x0F);
+    bool const masked = bytes[1] & 0x80;
+    if (!masked || (bytes[0] & 0x30) != 0) return ParseResult::protocol_error;
+    switch (opcode) {
+        case Opcode::continuation: case Opcode::text: case Opcode::binary:
+        case Opcode::close: case Opcode::ping: case Opcode::pong:
+            break;
+        default:
+            return ParseResult::protocol_error;
+    }
+
+    std::size_t header = 2;
+    std::uint64_t length = bytes[1] & 0x7F;
+    if (length == 126) {
+        if (size < 4) return ParseResult::need_more;
+        length = (std::uint64_t{bytes[2]} << 8) | bytes[3];
+        header = 4;
+        if (length < 126) return ParseResult::protocol_error;
+    } else if (length == 127) {
+        if (size < 10) return ParseResult::need_more;
+        length = 0;
+        for (int i = 0; i < 8; ++i) length = (length << 8) | bytes[2 + i];
+        header = 10;
+        // RFC 6455 5.2: 长度必须使用最短编码，64位长度的最高位必须为0
+        if (length <= 0xFFFF || (length >> 63) != 0) return ParseResult::protocol_error;
+    }
+    if (is_control(opcode) && (length > 125 || !fin)) return ParseResult::protocol_error;
+    if (length > max_payload) return ParseResult::too_large;
+
+    if (size < header + 4 + length) return ParseResult::need_more;
+    unsigned char mask[4];
+    std::memcpy(mask, bytes + header, 4);
+    char* payload = data + header + 4;
+    for (std::size_t i = 0; i < length; ++i) {
+        payload[i] = static_cast<char>(payload[i] ^ mask[i & 3]);
+    }
+
+    frame.opcode = opcode;
+    frame.fin = fin;
+    frame.rsv1 = rsv1;
+    frame.payload = std::string_view(payload, static_cast<std::size_t>(length));
+    consumed = header + 4 + static_cast<std::size_t>(length);
+    return ParseResult::frame;
+}
+
+/**
+ * @brief 检查对方close帧的payload：可以为空，否则前2字节是RFC 6455 7.4定义的可以出现在帧中的状态码。
+ */
+inline bool is_valid_close_payload(std::string_view payload) {
+    if (payload.empty()) return true;
+    if (payload.size() < 2) return false;
+    auto const code = static_cast<std::uint16_t>((static_cast<unsigned char>(payload[0]) << 8) |
+                                                 static_cast<unsigned char>(payload[1]));
+    // 1004保留，1005/1006/1015只用于本地报告，不能出现在帧中
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) || (code >= 3000 && code <= 4999);
+}
+
+} // namespace repeater::ws_frame
+
+#endif // REPEATER_WS_FRAME_HPP
@@ -0,0 +1,115 @@
+#include "repeater/clock_offset.hpp"
+#include <algorithm>
+
+namespace repeater {
+
+namespace {
+
+constexpr std::int64_t empty = std::numeric_limits<std::int64_t>::max();
+
+void atomic_min(std::atomic<std::int64_t>& target, std::int64_t value) {
+    auto current = target.load(std::memory_order_relaxed);
+    while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+} // namespace
+
+StaleGuardOptions StaleGuardOptions::from_json(const nlohmann::json& j) {
+    StaleGuardOptions o;
+    if (!j.is_object()) return o;
+    o.max_age_us = j.value("max_age_ms", std::int64_t{0}) * 1000;
+    o.drop = j.value("action", std::string("drop")) != "flag";
+    o.window = std::chrono::milliseconds(j.value("window_sec", 10) * 1000);
+    auto const overrides = j.value("channel_max_age_ms", nlohmann::json::object());
+    for (auto const& [channel, max_age_ms] : overrides.items()) {
+        o.channel_max_age_us.emplace(channel, max_age_ms.get<std::int64_t>() * 1000);
+    }
+    return o;
+}
+
+void ClockOffsetEstimator::WindowMin::update(std::int64_t epoch, std::int64_t value) {
+    auto& bucket = buckets[static_cast<std::size_t>(epoch) % bucket_count];
+    auto seen = bucket.epoch.load(std::memory_order_acquire);
+    if (seen != epoch) {
+        // 桶属于更早的时间段：由CAS成功的线程清空。与它并发的少数样本可能丢失，对最小值的估计没有影响
+        if (seen < epoch && bucket.epoch.compare_exchange_strong(seen, epoch, std::memory_order_acq_rel)) {
+            bucket.min.store(value, std::memory_order_relaxed);
+            return;
+        }
+        if (seen > epoch) return;
+    }
+    atomic_min(bucket.min, value);
+}
+
+std::int64_t ClockOffsetEstimator::WindowMin::get(std::int64_t epoch) const {
+    auto result = empty;
+    for (auto const& bucket : buckets) {
+        auto const bucket_epoch = bucket.epoch.load(std::memory_order_acquire);
+        if (bucket_epoch > epoch - static_cast<std::int64_t>(bucket_count) && bucket_epoch <= epoch) {
+            result = std::min(result, bucket.min.load(std::memory_order_relaxed));
+        }
+    }
+    return result;
+}
+
+void ClockOffsetEstimator::WindowMin::clear() {
+    for (auto& bucket : buckets) {
+        bucket.epoch.store(-1, std::memory_order_release);
+        bucket.min.store(empty, std::memory_order_relaxed);
+    }
+}
+
+ClockOffsetEstimator::ClockOffsetEstimator(std::chrono::milliseconds window)
+    : bucket_us_(std::max<std::int64_t>(1, std::chrono::duration_cast<std::chrono::microseconds>(window).count() /
+                                               static_cast<std::int64_t>(bucket_count))),
+      sources_(std::make_unique<std::array<Source, max_sources>>()) {}
+
+std::int64_t ClockOffsetEstimator::observe(int source_id, std::int64_t exchange_us, std::int64_t local_us) {
+    auto const delay = local_us - exchange_us;
+    auto const epoch = local_us / bucket_us_;
+    global_.update(epoch, delay);
+
+    if (source_id >= 0 && source_id < max_sources) {
+        auto& source = (*sources_)[static_cast<std::size_t>(source_id)];
+        source.window.update(epoch, delay);
+        // 每个来源只在自己连接的strand上更新，读-改-写不需要原子RMW
+        auto const samples = source.samples.load(std::memory_order_relaxed);
+        auto const ewma = source.ewma.load(std::memory_order_relaxed);
+        source.ewma.store(samples == 0 ? delay : ewma + (delay - ewma) / 64, std::memory_order_relaxed);
+        source.samples.store(samples + 1, std::memory_order_relaxed);
+    }
+    return delay - global_.get(epoch);
+}
+
+std::optional<std::int64_t> ClockOffsetEstimator::offset_us() const {
+    auto const now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    auto const min = global_.get(now / bucket_us_);
+    if (min == empty) return std::nullopt;
+    return min;
+}
+
+ClockOffsetEstimator::SourceLatency ClockOffsetEstimator::source(int source_id) const {
+    SourceLatency latency;
+    auto const offset = offset_us();
+    if (!offset || source_id < 0 || source_id >= max_sources) return latency;
+    auto const& source = (*sources_)[static_cast<std::size_t>(source_id)];
+    auto const now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    latency.samples = source.samples.load(std::memory_order_relaxed);
+    auto const min = source.window.get(now / bucket_us_);
+    latency.min_us = min == empty ? -1 : min - *offset;
+    latency.avg_us = latency.samples ? source.ewma.load(std::memory_order_relaxed) - *offset : -1;
+    return latency;
+}
+
+void ClockOffsetEstimator::reset_source(int source_id) {
+    if (source_id < 0 || source_id >= max_sources) return;
+    auto& source = (*sources_)[static_cast<std::size_t>(source_id)];
+    source.window.clear();
+    source.ewma.store(0, std::memory_order_relaxed);
+    source.samples.store(0, std::memory_order_relaxed);
+}
+
+} // namespace repeater
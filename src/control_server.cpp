@@ -0,0 +1,104 @@
+#include "repeater/control_server.hpp"
+#include "repeater/log.hpp"
+
+namespace repeater {
+
+class ControlSession : public std::enable_shared_from_this<ControlSession> {
+    beast::tcp_stream stream_;
+    beast::flat_buffer buffer_;
+    ControlServer::Request request_;
+    std::shared_ptr<ControlServer::Response> response_;
+    ControlServer::Handler handler_;
+
+public:
+    ControlSession(tcp::socket&& socket, ControlServer::Handler handler)
+        : stream_(std::move(socket)), handler_(std::move(handler)) {}
+
+    void run() {
+        net::dispatch(stream_.get_executor(),
+            beast::bind_front_handler(&ControlSession::do_read, shared_from_this()));
+    }
+
+private:
+    void do_read() {
+        request_ = {};
+        stream_.expires_after(std::chrono::seconds(30));
+        http::async_read(stream_, buffer_, request_,
+            beast::bind_front_handler(&ControlSession::on_read, shared_from_this()));
+    }
+
+    void on_read(beast::error_code ec, std::size_t) {
+        if (ec == http::error::end_of_stream) return do_close();
+        if (ec) return;
+
+        response_ = std::make_shared<ControlServer::Response>(handler_(request_));
+        response_->version(request_.version());
+        response_->keep_alive(request_.keep_alive());
+        response_->prepare_payload();
+
+        http::async_write(stream_, *response_,
+            beast::bind_front_handler(&ControlSession::on_write, shared_from_this()));
+    }
+
+    void on_write(beast::error_code ec, std::size_t) {
+        if (ec) return;
+        if (!response_->keep_alive()) return do_close();
+        do_read();
+    }
+
+    void do_close() {
+        beast::error_code ec;
+        stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+    }
+};
+
+ControlServer::ControlServer(net::io_context& ioc, tcp::endpoint endpoint, Handler handler, bool debug)
+    : ioc_(ioc), acceptor_(ioc), handler_(std::move(handler)), debug_(debug) {
+    beast::error_code ec;
+    acceptor_.open(endpoint.protocol(), ec);
+    if (ec) {
+        REPEATER_LOG(error, "[Control] Open error: {}", ec.message());
+        return;
+    }
+    acceptor_.set_option(net::socket_base::reuse_address(true), ec);
+    if (ec) {
+        REPEATER_LOG(error, "[Control] Set option error: {}", ec.message());
+        return;
+    }
+    acceptor_.bind(endpoint, ec);
+    if (ec) {
+        REPEATER_LOG(error, "[Control] Bind error: {}", ec.message());
+        return;
+    }
+    acceptor_.listen(net::socket_base::max_listen_connections, ec);
+    if (ec) {
+        REPEATER_LOG(error, "[Control] Listen error: {}", ec.message());
+        return;
+    }
+}
+
+void ControlServer::run() {
+    if (!acceptor_.is_open()) return;
+    if (debug_) {
+        auto const endpoint = acceptor_.local_endpoint();
+        REPEATER_LOG(debug, "[Control] Listening on {}:{}", endpoint.address().to_string(), endpoint.port());
+    }
+    do_accept();
+}
+
+void ControlServer::do_accept() {
+    acceptor_.async_accept(
+        net::make_strand(ioc_),
+        beast::bind_front_handler(&ControlServer::on_accept, shared_from_this()));
+}
+
+void ControlServer::on_accept(beast::error_code ec, tcp::socket socket) {
+    if (ec) {
+        REPEATER_LOG(error, "[Control] Accept error: {}", ec.message());
+    } else {
+        std::make_shared<ControlSession>(std::move(socket), handler_)->run();
+    }
+    do_accept();
+}
+
+} // namespace repeater
@@ -0,0 +1,36 @@
+#include "repeater/dedup_policy.hpp"
+
+namespace repeater {
+
+const char* to_string(DedupKind kind) {
+    switch (kind) {
+        case DedupKind::seq_id: return "seq_id";
+        case DedupKind::trade_id: return "trade_id";
+        case DedupKind::snapshot: return "snapshot";
+        case DedupKind::pass_through: return "pass_through";
+    }
+    return "unknown";
+}
+
+std::optional<DedupKind> parse_dedup_kind(std::string_view name) {
+    if (name == "seq_id") return DedupKind::seq_id;
+    if (name == "trade_id") return DedupKind::trade_id;
+    if (name == "snapshot") return DedupKind::snapshot;
+    if (name == "pass_through") return DedupKind::pass_through;
+    return std::nullopt;
+}
+
+DedupKind default_dedup_kind(std::string_view channel) {
+    // 订单簿类: books, books5, books-l2-tbt, books50-l2-tbt, bbo-tbt ... 都带seqId
+    if (channel.rfind("books", 0) == 0 || channel == "bbo-tbt") {
+        return DedupKind::seq_id;
+    }
+    if (channel == "trades" || channel == "trades-all") {
+        return DedupKind::trade_id;
+    }
+    // tickers, mark-price, funding-rate, index-tickers, open-interest, candle*, ... 以及其它未知频道:
+    // 这些推送都是带ts的快照，按(ts, 内容哈希)去重
+    return DedupKind::snapshot;
+}
+
+} // namespace repeater
@@ -0,0 +1,332 @@
+#include "repeater/log.hpp"
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace repeater::log {
+
+namespace detail {
+
+std::atomic<Level> level{Level::info};
+std::uint32_t rate_limit = 1000;
+
+} // namespace detail
+
+namespace {
+
+struct Registry {
+    std::mutex mutex;  // 保护queues和输出
+    std::vector<std::unique_ptr<detail::Queue>> queues;
+    std::size_t queue_size = 2048;
+    std::FILE* file = nullptr;
+    std::atomic<bool> running{false};
+    std::atomic<std::uint64_t> dropped{0};
+    std::uint64_t reported_dropped = 0;
+
+    std::thread writer;
+    std::mutex writer_mutex;
+    std::condition_variable writer_cv;
+    bool stopping = false;
+    std::chrono::milliseconds poll{5};
+
+    // 后台线程的工作区，只在writer线程(或持有mutex时)使用
+    std::vector<detail::Record> batch;
+    std::string out;
+    std::string err;
+
+    // 进程退出时没有调用shutdown()的情况下也要结束后台线程
+    ~Registry() {
+        if (!writer.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(writer_mutex);
+            stopping = true;
+        }
+        writer_cv.notify_one();
+        writer.join();
+    }
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// 线程退出时释放它的队列，队列中剩余的记录仍会被写出
+struct Attachment {
+    detail::Queue* queue = nullptr;
+    ~Attachment() {
+        if (queue) queue->attached.store(false, std::memory_order_release);
+    }
+};
+
+thread_local Attachment attachment;
+thread_local detail::Record sync_record;
+
+std::size_t round_up_pow2(std::size_t n) {
+    std::size_t size = 1;
+    while (size < n) size <<= 1;
+    return size;
+}
+
+detail::Queue* attach_queue() {
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto const& queue : reg.queues) {
+        // 已退出线程的队列，写空之后可以复用
+        if (!queue->attached.load(std::memory_order_acquire) &&
+            queue->head.load(std::memory_order_acquire) == queue->tail.load(std::memory_order_acquire)) {
+            queue->attached.store(true, std::memory_order_relaxed);
+            return queue.get();
+        }
+    }
+    auto queue = std::make_unique<detail::Queue>();
+    queue->records = std::make_unique<detail::Record[]>(reg.queue_size);
+    queue->mask = reg.queue_size - 1;
+    reg.queues.push_back(std::move(queue));
+    return reg.queues.back().get();
+}
+
+template <typename T>
+T read_arg(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief 取出args中offset处的下一个参数并追加到out，返回false表示没有更多参数。
+ */
+bool append_arg(const detail::Record& record, std::size_t& offset, std::string& out) {
+    if (offset >= record.header.size) return false;
+    auto const* data = record.args + offset + 1;
+    switch (static_cast<detail::ArgType>(record.args[offset])) {
+        case detail::ArgType::i64:
+            out += std::to_string(read_arg<std::int64_t>(data));
+            offset += 1 + sizeof(std::int64_t);
+            return true;
+        case detail::ArgType::u64:
+            out += std::to_string(read_arg<std::uint64_t>(data));
+            offset += 1 + sizeof(std::uint64_t);
+            return true;
+        case detail::ArgType::f64: {
+            char buffer[32];
+            auto const n = std::snprintf(buffer, sizeof(buffer), "%g", read_arg<double>(data));
+            out.append(buffer, static_cast<std::size_t>(std::max(n, 0)));
+            offset += 1 + sizeof(double);
+            return true;
+        }
+        case detail::ArgType::boolean:
+            out += read_arg<bool>(data) ? "true" : "false";
+            offset += 1 + sizeof(bool);
+            return true;
+        case detail::ArgType::character:
+            out.push_back(*data);
+            offset += 2;
+            return true;
+        case detail::ArgType::string: {
+            auto const length = read_arg<std::uint16_t>(data);
+            out.append(data + sizeof(std::uint16_t), length);
+            offset += 1 + sizeof(std::uint16_t) + length;
+            return true;
+        }
+    }
+    return false;
+}
+
+void format(const detail::Record& record, std::string& out) {
+    auto const seconds = static_cast<std::time_t>(record.header.time_ns / 1000000000);
+    std::tm tm{};
+    ::localtime_r(&seconds, &tm);
+    char prefix[48];
+    auto const n = std::snprintf(prefix, sizeof(prefix), "%04d-%02d-%02d %02d:%02d:%02d.%06lld %-5s ",
+                                 tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                                 static_cast<long long>(record.header.time_ns % 1000000000 / 1000),
+                                 to_string(record.header.site->level));
+    out.append(prefix, static_cast<std::size_t>(std::max(n, 0)));
+
+    std::size_t offset = 0;
+    for (const char* p = record.header.site->format; *p; ++p) {
+        if (p[0] == '{' && p[1] == '}' && append_arg(record, offset, out)) {
+            ++p;
+            continue;
+        }
+        out.push_back(*p);
+    }
+    if (record.header.suppressed) {
+        out += " (" + std::to_string(record.header.suppressed) + " similar suppressed)";
+    }
+    out.push_back('\n');
+}
+
+// 调用方持有reg.mutex
+void emit(Registry& reg, const detail::Record& record) {
+    auto& target = reg.file || record.header.site->level < Level::warn ? reg.out : reg.err;
+    format(record, target);
+}
+
+void flush(Registry& reg) {
+    if (reg.file) {
+        std::fwrite(reg.out.data(), 1, reg.out.size(), reg.file);
+        std::fflush(reg.file);
+    } else {
+        std::fwrite(reg.out.data(), 1, reg.out.size(), stdout);
+        std::fflush(stdout);
+        std::fwrite(reg.err.data(), 1, reg.err.size(), stderr);
+    }
+    reg.out.clear();
+    reg.err.clear();
+}
+
+/**
+ * @brief 取出所有队列中的记录，按时间排序后格式化写出。
+ */
+void drain(Registry& reg) {
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.batch.clear();
+    for (auto const& queue : reg.queues) {
+        auto tail = queue->tail.load(std::memory_order_relaxed);
+        auto const head = queue->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) reg.batch.push_back(queue->records[tail & queue->mask]);
+        queue->tail.store(tail, std::memory_order_release);
+    }
+    std::stable_sort(reg.batch.begin(), reg.batch.end(), [](auto const& a, auto const& b) {
+        return a.header.time_ns < b.header.time_ns;
+    });
+    for (auto const& record : reg.batch) emit(reg, record);
+
+    auto const dropped = reg.dropped.load(std::memory_order_relaxed);
+    if (dropped != reg.reported_dropped) {
+        (reg.file ? reg.out : reg.err) += "[Log] " + std::to_string(dropped - reg.reported_dropped) +
+                                          " records dropped, queue full\n";
+        reg.reported_dropped = dropped;
+    }
+    if (!reg.out.empty() || !reg.err.empty()) flush(reg);
+}
+
+} // namespace
+
+const char* to_string(Level level) {
+    switch (level) {
+        case Level::debug: return "DEBUG";
+        case Level::info: return "INFO";
+        case Level::warn: return "WARN";
+        case Level::error: return "ERROR";
+        default: return "OFF";
+    }
+}
+
+Options Options::from_json(const nlohmann::json& config, bool debug) {
+    Options options;
+    options.level = debug ? Level::debug : Level::info;
+    if (!config.is_object()) return options;
+    auto name = config.value("level", std::string());
+    for (auto& c : name) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    for (auto const candidate : {Level::debug, Level::info, Level::warn, Level::error, Level::off}) {
+        if (name == to_string(candidate)) options.level = candidate;
+    }
+    options.file = config.value("file", options.file);
+    options.queue_size = config.value("queue_size", options.queue_size);
+    options.rate_limit = config.value("rate_limit", options.rate_limit);
+    options.poll_ms = config.value("poll_ms", options.poll_ms);
+    return options;
+}
+
+void configure(const Options& options) {
+    auto& reg = registry();
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.queue_size = round_up_pow2(std::max<std::size_t>(options.queue_size, 64));
+        if (reg.file) {
+            std::fclose(reg.file);
+            reg.file = nullptr;
+        }
+        if (!options.file.empty()) {
+            reg.file = std::fopen(options.file.c_str(), "a");
+            if (!reg.file) std::fprintf(stderr, "[Log] Could not open %s, writing to stdout\n", options.file.c_str());
+        }
+    }
+    detail::level.store(options.level, std::memory_order_relaxed);
+    detail::rate_limit = options.rate_limit;
+    reg.poll = std::chrono::milliseconds(std::max(options.poll_ms, 1));
+    if (options.level == Level::off || reg.writer.joinable()) return;
+
+    reg.stopping = false;
+    reg.running.store(true, std::memory_order_release);
+    reg.writer = std::thread([&reg] {
+        std::unique_lock<std::mutex> lock(reg.writer_mutex);
+        for (;;) {
+            // 调用线程从不唤醒这个线程，热路径上没有系统调用；按固定间隔检查队列
+            reg.writer_cv.wait_for(lock, reg.poll, [&reg] { return reg.stopping; });
+            bool const stopping = reg.stopping;
+            lock.unlock();
+            drain(reg);
+            if (stopping) return;
+            lock.lock();
+        }
+    });
+}
+
+void shutdown() {
+    auto& reg = registry();
+    if (!reg.writer.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(reg.writer_mutex);
+        reg.stopping = true;
+    }
+    reg.writer_cv.notify_one();
+    reg.writer.join();
+    reg.running.store(false, std::memory_order_release);
+    // 停止之前被取出队列的记录已写完；此后仍在运行的线程写入的记录由同步路径写出
+    drain(reg);
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if (reg.file) {
+        std::fclose(reg.file);
+        reg.file = nullptr;
+    }
+}
+
+std::uint64_t dropped() {
+    return registry().dropped.load(std::memory_order_relaxed);
+}
+
+namespace detail {
+
+Record* acquire(std::int64_t time_ns) {
+    auto& reg = registry();
+    Record* record = nullptr;
+    if (!reg.running.load(std::memory_order_acquire)) {
+        record = &sync_record;
+    } else {
+        auto* queue = attachment.queue;
+        if (!queue) queue = attachment.queue = attach_queue();
+        auto const head = queue->head.load(std::memory_order_relaxed);
+        if (head - queue->tail.load(std::memory_order_acquire) > queue->mask) {
+            reg.dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        record = &queue->records[head & queue->mask];
+    }
+    record->header.time_ns = time_ns;
+    record->header.size = 0;
+    return record;
+}
+
+void commit(Record* record) {
+    auto& reg = registry();
+    if (record == &sync_record) {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        emit(reg, *record);
+        flush(reg);
+        return;
+    }
+    auto* queue = attachment.queue;
+    queue->head.store(queue->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+} // namespace detail
+
+} // namespace repeater::log
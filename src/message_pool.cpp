@@ -0,0 +1,64 @@
+#include "repeater/message_pool.hpp"
+#include "repeater/trace.hpp"
+#include <cstring>
+
+namespace repeater {
+
+MessagePool::MessagePool(std::size_t slot_size, std::size_t slot_count, const RuntimeProfile& profile)
+    : slot_size_(slot_size),
+      slot_count_(slot_count),
+      slab_((ws_frame::max_header_size + slot_size) * slot_count, profile, "Message pool"),
+      slots_(new MessageBuffer[slot_count])
+{
+    for (std::size_t i = 0; i < slot_count; ++i) {
+        MessageBuffer& slot = slots_[i];
+        slot.pool_ = this;
+        slot.storage_ = slab_.data() + i * (ws_frame::max_header_size + slot_size) + ws_frame::max_header_size;
+        slot.capacity_ = slot_size;
+        slot.next_free_ = free_list_;
+        free_list_ = &slot;
+    }
+}
+
+MessagePool::~MessagePool() = default;
+
+MessagePtr MessagePool::acquire(std::string_view payload, ws_frame::Opcode opcode, bool compressed) {
+    MessageBuffer* buffer = nullptr;
+    if (payload.size() <= slot_size_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffer = free_list_;
+        if (buffer) {
+            free_list_ = buffer->next_free_;
+        }
+    }
+
+    if (buffer) {
+        in_use_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        // 超大消息或池耗尽：退化为堆分配，释放时直接delete
+        overflow_count_.fetch_add(1, std::memory_order_relaxed);
+        buffer = new MessageBuffer();
+        buffer->storage_ = new char[ws_frame::max_header_size + payload.size()] + ws_frame::max_header_size;
+        buffer->capacity_ = payload.size();
+    }
+
+    std::memcpy(buffer->storage_, payload.data(), payload.size());
+    buffer->size_ = payload.size();
+    buffer->trace_id_ = trace::current_id();
+    buffer->trace_start_ = trace::current_start();
+
+    // 帧头对所有会话都相同，先写到临时区再右对齐到payload之前
+    unsigned char header[ws_frame::max_header_size];
+    buffer->header_size_ = ws_frame::encode_header(header, opcode, payload.size(), true, compressed);
+    std::memcpy(buffer->storage_ - buffer->header_size_, header, buffer->header_size_);
+    return MessagePtr(buffer);
+}
+
+void MessagePool::release(MessageBuffer* buffer) noexcept {
+    in_use_.fetch_sub(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer->next_free_ = free_list_;
+    free_list_ = buffer;
+}
+
+} // namespace repeater
@@ -1,50 +1,242 @@
 #include "repeater/message_processor.hpp"
-#include "nlohmann/json.hpp"
-#include <iostream>
+#include "repeater/json_scan.hpp"
+#include "repeater/log.hpp"
+#include "repeater/trace.hpp"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <variant>
 
 namespace repeater {
 
-MessageProcessor::MessageProcessor(std::function<void(std::string_view)> forward_callback, bool debug)
-    : forward_callback_(std::move(forward_callback)), debug_(debug) {}
+struct MessageProcessor::Stream {
+    std::string channel;
+    std::string inst_id;
+    std::size_t index = 0;
+    std::int64_t max_age_us = 0;  // 0表示不检查
+    std::mutex mutex;
+    std::variant<SeqIdPolicy, TradeIdPolicy, SnapshotPolicy, PassThroughPolicy> policy;
+};
 
-void MessageProcessor::process(std::string_view message) {
-    try {
-        auto json_msg = nlohmann::json::parse(message);
+namespace {
 
-        if (!json_msg.contains("arg") || !json_msg.contains("data")) {
-            return;
+/**
+ * 在栈上拼接 "channel|instId" 作为流的key，查找时不产生分配。
+ */
+class StreamKey {
+public:
+    StreamKey(std::string_view channel, std::string_view inst_id) {
+        const std::size_t size = channel.size() + 1 + inst_id.size();
+        if (size <= buffer_.size()) {
+            std::memcpy(buffer_.data(), channel.data(), channel.size());
+            buffer_[channel.size()] = '|';
+            std::memcpy(buffer_.data() + channel.size() + 1, inst_id.data(), inst_id.size());
+            view_ = std::string_view(buffer_.data(), size);
+        } else {
+            overflow_.append(channel).append(1, '|').append(inst_id);
+            view_ = overflow_;
         }
+    }
+
+    std::string_view view() const { return view_; }
+
+private:
+    std::array<char, 128> buffer_;
+    std::string overflow_;
+    std::string_view view_;
+};
+
+/**
+ * 流的第二个维度：通常是instId；部分频道(如opt-summary)按instFamily或instType订阅。
+ */
+std::string_view inst_key_of(std::string_view arg) {
+    for (auto const field : {"instId", "instFamily", "instType"}) {
+        auto const value = json_scan::find_field(arg, field);
+        if (!value.empty()) return value;
+    }
+    return {};
+}
+
+/**
+ * 数据第一个元素的ts(毫秒)，转换为微秒。candle等数组形式的元素不参与时钟估计。
+ */
+std::optional<std::int64_t> exchange_us_of(std::string_view first) {
+    if (first.front() != '{') return std::nullopt;
+    auto const ts = json_scan::to_int64(json_scan::find_field(first, "ts"));
+    if (!ts) return std::nullopt;
+    return *ts * 1000;
+}
+
+std::int64_t local_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+MessageProcessor::MessageProcessor(ForwardCallback forward_callback, bool debug, DedupOverrides overrides,
+                                   StaleGuardOptions stale_guard)
+    : overrides_(std::move(overrides)), forward_callback_(std::move(forward_callback)), debug_(debug),
+      stale_guard_(std::move(stale_guard)), clock_(std::make_unique<ClockOffsetEstimator>(stale_guard_.window)) {}
 
-        const auto& data_array = json_msg["data"];
-        if (data_array.empty() || !data_array[0].contains("seqId")) {
-            return;
+MessageProcessor::~MessageProcessor() = default;
+
+MessageProcessor::DedupOverrides MessageProcessor::parse_overrides(const nlohmann::json& config) {
+    DedupOverrides overrides;
+    if (!config.is_object()) return overrides;
+    for (auto const& [channel, name] : config.items()) {
+        auto const kind = parse_dedup_kind(name.get<std::string>());
+        if (!kind) {
+            throw std::invalid_argument("Unknown dedup policy '" + name.get<std::string>() + "' for channel " + channel);
         }
-        
-        int64_t seq_id = data_array[0]["seqId"].get<int64_t>();
-
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            if (seq_id <= max_seq_id_) {
-                if (debug_) {
-                    std::cout << "[Processor] Discarding old or duplicate message with seqId: " << seq_id 
-                              << " (max is " << max_seq_id_ << ")" << std::endl;
-                }
-                return; // 丢弃旧的或重复的消息
+        overrides.emplace(channel, *kind);
+    }
+    return overrides;
+}
+
+DedupKind MessageProcessor::kind_for(std::string_view channel) const {
+    auto const it = overrides_.find(std::string(channel));
+    return it != overrides_.end() ? it->second : default_dedup_kind(channel);
+}
+
+void MessageProcessor::register_subscriptions(const nlohmann::json& args) {
+    if (!args.is_array()) return;
+    for (auto const& arg : args) {
+        if (!arg.contains("channel")) continue;
+        auto const channel = arg["channel"].get<std::string>();
+        std::string inst;
+        for (auto const field : {"instId", "instFamily", "instType"}) {
+            if (arg.contains(field)) {
+                inst = arg[field].get<std::string>();
+                break;
             }
-            max_seq_id_ = seq_id;
         }
+        auto& stream = find_or_create(channel, inst);
+        if (debug_) {
+            REPEATER_LOG(debug, "[Processor] Stream {}:{} uses {} dedup.", stream.channel, stream.inst_id,
+                         std::visit([](auto const& p) { return to_string(p.kind); }, stream.policy));
+        }
+    }
+}
+
+MessageProcessor::Stream& MessageProcessor::find_or_create(std::string_view channel, std::string_view inst_id) {
+    StreamKey const key(channel, inst_id);
+    {
+        std::shared_lock<std::shared_mutex> lock(streams_mutex_);
+        auto const it = streams_.find(key.view());
+        if (it != streams_.end()) return *it->second;
+    }
+
+    // 新的流：持有写锁再查一次，只有真正插入的线程才创建策略。
+    // 策略的表从热区分配，热区内的释放不回收空间，竞争失败后丢弃的对象会永久占用热区
+    std::unique_lock<std::shared_mutex> lock(streams_mutex_);
+    if (auto const it = streams_.find(key.view()); it != streams_.end()) return *it->second;
+
+    auto stream = std::make_unique<Stream>();
+    stream->channel = std::string(channel);
+    stream->inst_id = std::string(inst_id);
+    stream->index = streams_.size();
+    auto const max_age = stale_guard_.channel_max_age_us.find(stream->channel);
+    stream->max_age_us = max_age != stale_guard_.channel_max_age_us.end() ? max_age->second : stale_guard_.max_age_us;
+    switch (kind_for(channel)) {
+        case DedupKind::seq_id: stream->policy.emplace<SeqIdPolicy>(); break;
+        case DedupKind::trade_id: stream->policy.emplace<TradeIdPolicy>(); break;
+        case DedupKind::snapshot: stream->policy.emplace<SnapshotPolicy>(); break;
+        case DedupKind::pass_through: stream->policy.emplace<PassThroughPolicy>(); break;
+    }
+    auto& result = *stream;
+    streams_.emplace(std::string(key.view()), std::move(stream));
+    return result;
+}
+
+std::uint64_t MessageProcessor::wins(int source_id) const {
+    if (source_id < 0 || source_id >= max_sources) return 0;
+    return wins_[source_id].load(std::memory_order_relaxed);
+}
+
+void MessageProcessor::reset_source(int source_id) {
+    if (source_id < 0 || source_id >= max_sources) return;
+    wins_[source_id].store(0, std::memory_order_relaxed);
+    clock_->reset_source(source_id);
+}
+
+void MessageProcessor::process(std::string_view message, int source_id) {
+    // 只扫描需要的字段，不构建JSON DOM，热路径上没有堆分配
+    auto const arg = json_scan::find_field(message, "arg");
+    if (arg.empty()) {
+        return;
+    }
+    auto const data_array = json_scan::find_field(message, "data");
+    auto const first = json_scan::first_element(data_array);
+    if (first.empty()) {
+        return;
+    }
+    trace::stamp(trace::Stage::extract);
 
-        // 转发最新的消息
+    Stream& stream = find_or_create(json_scan::find_field(arg, "channel"), inst_key_of(arg));
+    // 所有到达(包括稍后被去重丢弃的)都是时钟偏差和各连接延迟的样本
+    std::int64_t age_us = -1;
+    if (auto const exchange_us = exchange_us_of(first)) {
+        age_us = clock_->observe(source_id, *exchange_us, local_us());
+    }
+    std::visit([&](auto& policy) { process_with(stream, policy, message, data_array, first, source_id, age_us); },
+               stream.policy);
+}
+
+template <class Policy>
+void MessageProcessor::process_with(Stream& stream, Policy& policy, std::string_view message,
+                                    std::string_view data, std::string_view first, int source_id,
+                                    std::int64_t age_us) {
+    DedupDecision decision;
+    int64_t key;
+    {
+        std::lock_guard<std::mutex> lock(stream.mutex);
+        decision = policy.accept(data, first);
+        key = policy.last_key;
+    }
+    trace::stamp(trace::Stage::dedup, decision == DedupDecision::forward ? 1 : 0);
+
+    if (decision == DedupDecision::no_key) {
         if (debug_) {
-            std::cout << "[Processor] Forwarding newest message with seqId: " << seq_id << std::endl;
+            REPEATER_LOG(warn, "[Processor] Message on {}:{} lacks the {} key.\nMessage: {}", stream.channel,
+                         stream.inst_id, to_string(Policy::kind), message);
         }
-        forward_callback_(message);
+        return;
+    }
+    if (decision == DedupDecision::duplicate) {
+        if (debug_) {
+            REPEATER_LOG(debug, "[Processor] Discarding old or duplicate message on {}:{} ({} {})", stream.channel,
+                         stream.inst_id, to_string(Policy::kind), key);
+        }
+        return; // 丢弃旧的或重复的消息
+    }
 
-    } catch (const nlohmann::json::parse_error& e) {
+    // 转发首次到达的消息
+    if (debug_) {
+        REPEATER_LOG(debug, "[Processor] Forwarding newest message on {}:{} ({} {}) from source {}", stream.channel,
+                     stream.inst_id, to_string(Policy::kind), key, source_id);
+    }
+    ForwardedMessage forwarded{message, stream.channel, stream.inst_id, key, source_id, stream.index, age_us, message};
+    if (stream.max_age_us > 0 && age_us > stream.max_age_us) {
+        stale_.fetch_add(1, std::memory_order_relaxed);
         if (debug_) {
-            std::cerr << "[Processor] JSON parse error: " << e.what() << "\nMessage: " << message << std::endl;
+            REPEATER_LOG(debug, "[Processor] Stale message on {}:{} ({} {}) from source {} is {}us late, {}", stream.channel,
+                         stream.inst_id, to_string(Policy::kind), key, source_id, age_us,
+                         stale_guard_.drop ? "dropping" : "flagging");
         }
+        if (stale_guard_.drop) return;
+        // 在顶层对象的开头插入标记，下游不需要解析data就能识别。标记只针对本节点的时钟，
+        // 联邦对端收到原始消息，由它按自己的时钟判断
+        thread_local std::string flagged;
+        flagged.assign(R"({"stale":true,"ageUs":)").append(std::to_string(age_us)).append(",").append(message.substr(1));
+        forwarded.local_payload = flagged;
+    }
+    // 被丢弃的过时消息不计入胜出次数
+    if (source_id >= 0 && source_id < max_sources) {
+        wins_[source_id].fetch_add(1, std::memory_order_relaxed);
     }
+    forward_callback_(forwarded);
 }
 
-} // namespace repeater
\ No newline at end of file
+} // namespace repeater
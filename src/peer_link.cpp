@@ -0,0 +1,338 @@
+#include "repeater/peer_link.hpp"
+#include "repeater/log.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <arpa/inet.h>
+#include <cstring>
+
+namespace repeater {
+
+namespace {
+
+void put_u32(unsigned char* out, std::uint32_t v) {
+    v = htonl(v);
+    std::memcpy(out, &v, sizeof(v));
+}
+
+void put_u16(unsigned char* out, std::uint16_t v) {
+    v = htons(v);
+    std::memcpy(out, &v, sizeof(v));
+}
+
+std::uint32_t get_u32(const unsigned char* in) {
+    std::uint32_t v;
+    std::memcpy(&v, in, sizeof(v));
+    return ntohl(v);
+}
+
+std::uint16_t get_u16(const unsigned char* in) {
+    std::uint16_t v;
+    std::memcpy(&v, in, sizeof(v));
+    return ntohs(v);
+}
+
+} // namespace
+
+void PeerFrameHeader::encode(std::array<unsigned char, size>& out) const {
+    put_u32(&out[0], magic);
+    put_u16(&out[4], version);
+    put_u16(&out[6], 0);
+    put_u32(&out[8], origin_node);
+    put_u32(&out[12], length);
+}
+
+bool PeerFrameHeader::decode(const std::array<unsigned char, size>& in) {
+    if (get_u32(&in[0]) != magic || get_u16(&in[4]) != version || get_u16(&in[6]) != 0) {
+        return false;
+    }
+    origin_node = get_u32(&in[8]);
+    length = get_u32(&in[12]);
+    return length <= max_length;
+}
+
+// ---------------------------------------------------------------------------
+// PeerSender
+
+PeerSender::PeerSender(net::io_context& ioc, std::string address, std::uint32_t node_id,
+                       const SocketProfile& socket_profile, bool debug)
+    : address_(std::move(address)),
+      node_id_(node_id),
+      socket_profile_(socket_profile),
+      debug_(debug),
+      socket_(net::make_strand(ioc)),
+      resolver_(socket_.get_executor()),
+      reconnect_timer_(socket_.get_executor())
+{
+    queue_.reserve(max_queue);
+    inbox_.reserve(max_queue);
+    headers_.reserve(max_queue);
+    buffers_.reserve(max_queue * 2);
+}
+
+void PeerSender::run() {
+    auto const colon = address_.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+        REPEATER_LOG(error, "[Peer {}] Invalid peer address, expected host:port", address_);
+        return;
+    }
+    host_ = address_.substr(0, colon);
+    port_ = address_.substr(colon + 1);
+    net::dispatch(socket_.get_executor(), [self = shared_from_this()] { self->do_resolve(); });
+}
+
+void PeerSender::do_resolve() {
+    resolver_.async_resolve(host_, port_,
+        beast::bind_front_handler(&PeerSender::on_resolve, shared_from_this()));
+}
+
+void PeerSender::on_resolve(beast::error_code ec, tcp::resolver::results_type results) {
+    if (ec) return fail(ec, "resolve");
+    endpoints_ = std::move(results);
+    next_endpoint_ = endpoints_.begin();
+    do_connect(net::error::host_not_found);
+}
+
+void PeerSender::do_connect(beast::error_code last) {
+    // 依次尝试每个地址，每次都先打开socket并应用profile再连接，SO_RCVBUF才能参与窗口缩放的协商
+    if (next_endpoint_ == endpoints_.end()) return fail(last, "connect");
+    auto const endpoint = next_endpoint_->endpoint();
+    ++next_endpoint_;
+    beast::error_code ec;
+    socket_.close(ec);
+    socket_.open(endpoint.protocol(), ec);
+    if (ec) return do_connect(ec);
+    apply_socket_profile(socket_, socket_profile_, "Peer");
+    socket_.async_connect(endpoint, beast::bind_front_handler(&PeerSender::on_connect, shared_from_this()));
+}
+
+void PeerSender::on_connect(beast::error_code ec) {
+    if (ec == net::error::operation_aborted) return;
+    if (ec) return do_connect(ec);
+    connected_ = true;
+    if (debug_) REPEATER_LOG(debug, "[Peer {}] Connected.", address_);
+}
+
+void PeerSender::publish(MessagePtr const& msg) {
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        if (queued_ + inbox_.size() >= max_queue) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return; // 对端跟不上，丢弃而不是无限堆积
+        }
+        inbox_.push_back(msg);
+        if (drain_scheduled_) return;
+        drain_scheduled_ = true;
+    }
+    net::post(socket_.get_executor(), make_alloc_handler(write_memory_,
+        beast::bind_front_handler(&PeerSender::on_drain, shared_from_this())));
+}
+
+void PeerSender::on_drain() {
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        drain_scheduled_ = false;
+        if (!connected_) {
+            inbox_.clear();
+            return;
+        }
+        if (queue_.empty()) {
+            queue_.swap(inbox_);
+        } else {
+            queue_.insert(queue_.end(), inbox_.begin(), inbox_.end());
+            inbox_.clear();
+        }
+        queued_ = queue_.size();
+    }
+    if (!writing_ && !queue_.empty()) {
+        do_write();
+    }
+}
+
+void PeerSender::do_write() {
+    // 把当前排队的所有帧合并成一次gather写
+    in_flight_ = queue_.size();
+    headers_.resize(in_flight_);
+    buffers_.clear();
+    PeerFrameHeader header;
+    header.origin_node = node_id_;
+    for (std::size_t i = 0; i < in_flight_; ++i) {
+        header.length = static_cast<std::uint32_t>(queue_[i]->size());
+        header.encode(headers_[i]);
+        buffers_.emplace_back(headers_[i].data(), headers_[i].size());
+        buffers_.emplace_back(queue_[i]->data(), queue_[i]->size());
+    }
+    writing_ = true;
+    net::async_write(socket_, buffers_, make_alloc_handler(write_memory_,
+        beast::bind_front_handler(&PeerSender::on_write, shared_from_this())));
+}
+
+void PeerSender::on_write(beast::error_code ec, std::size_t) {
+    writing_ = false;
+    if (ec) return fail(ec, "write");
+    queue_.erase(queue_.begin(), queue_.begin() + static_cast<std::ptrdiff_t>(in_flight_));
+    in_flight_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        queued_ = queue_.size();
+    }
+    if (!queue_.empty()) {
+        do_write();
+    }
+}
+
+void PeerSender::fail(beast::error_code ec, char const* what) {
+    if (ec == net::error::operation_aborted) return;
+
+    REPEATER_LOG(error, "[Peer {}] Error in {}: {}", address_, what, ec.message());
+    connected_ = false;
+    queue_.clear();
+    in_flight_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(inbox_mutex_);
+        queued_ = 0;
+    }
+    beast::error_code ignored;
+    socket_.close(ignored);
+
+    reconnect_timer_.expires_after(std::chrono::seconds(1));
+    reconnect_timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+        if (ec) return;
+        self->do_resolve();
+    });
+}
+
+// ---------------------------------------------------------------------------
+// PeerListener
+
+class PeerConnection : public std::enable_shared_from_this<PeerConnection> {
+    strand_socket socket_;
+    std::shared_ptr<PeerListener> listener_;  // 对端映射和sink属于监听端
+
+    std::array<unsigned char, PeerFrameHeader::size> header_bytes_;
+    PeerFrameHeader header_;
+    std::vector<char> payload_;
+    std::uint32_t origin_node_ = 0;
+    int source_id_ = -1;
+    HandlerMemory read_memory_;
+
+public:
+    PeerConnection(strand_socket&& socket, std::shared_ptr<PeerListener> listener)
+        : socket_(std::move(socket)), listener_(std::move(listener)) {
+        payload_.reserve(64 * 1024);
+    }
+
+    void run() {
+        net::dispatch(socket_.get_executor(), [self = shared_from_this()] { self->do_read_header(); });
+    }
+
+private:
+    void do_read_header() {
+        net::async_read(socket_, net::buffer(header_bytes_), make_alloc_handler(read_memory_,
+            beast::bind_front_handler(&PeerConnection::on_read_header, shared_from_this())));
+    }
+
+    void on_read_header(beast::error_code ec, std::size_t) {
+        if (ec) return close(ec, "read header");
+        if (!header_.decode(header_bytes_)) {
+            REPEATER_LOG(error, "[Peer Listener] Malformed frame header, closing link.");
+            return close({}, nullptr);
+        }
+
+        if (source_id_ < 0) {
+            auto const it = listener_->origin_sources_.find(header_.origin_node);
+            if (it == listener_->origin_sources_.end()) {
+                REPEATER_LOG(error, "[Peer Listener] Rejecting link from unconfigured node {}", header_.origin_node);
+                return close({}, nullptr);
+            }
+            origin_node_ = header_.origin_node;
+            source_id_ = it->second;
+            if (listener_->debug_) {
+                REPEATER_LOG(debug, "[Peer Listener] Link established from node {}", header_.origin_node);
+            }
+        } else if (header_.origin_node != origin_node_) {
+            // 来源id按建立链路的节点分配，之后的帧不能冒用其它节点的身份
+            REPEATER_LOG(error, "[Peer Listener] Frame from node {} on the link of node {}, closing link.",
+                         header_.origin_node, origin_node_);
+            return close({}, nullptr);
+        }
+
+        payload_.resize(header_.length);
+        net::async_read(socket_, net::buffer(payload_), make_alloc_handler(read_memory_,
+            beast::bind_front_handler(&PeerConnection::on_read_payload, shared_from_this())));
+    }
+
+    void on_read_payload(beast::error_code ec, std::size_t) {
+        if (ec) return close(ec, "read payload");
+
+        // 环路抑制：自己发出的消息不再进入竞争
+        if (header_.origin_node != listener_->node_id_) {
+            listener_->sink_(std::string_view(payload_.data(), payload_.size()), source_id_);
+        }
+        do_read_header();
+    }
+
+    void close(beast::error_code ec, char const* what) {
+        if (what && ec != net::error::eof && ec != net::error::operation_aborted) {
+            REPEATER_LOG(error, "[Peer Listener] Error in {}: {}", what, ec.message());
+        }
+        beast::error_code ignored;
+        socket_.close(ignored);
+    }
+};
+
+PeerListener::PeerListener(net::io_context& ioc, tcp::endpoint endpoint, std::uint32_t node_id,
+                           std::unordered_map<std::uint32_t, int> origin_sources, Sink sink,
+                           const SocketProfile& socket_profile, bool debug)
+    : ioc_(ioc), acceptor_(ioc), node_id_(node_id), origin_sources_(std::move(origin_sources)),
+      sink_(std::move(sink)), socket_profile_(socket_profile), debug_(debug) {
+    beast::error_code ec;
+    acceptor_.open(endpoint.protocol(), ec);
+    if (ec) {
+        REPEATER_LOG(error, "[Peer Listener] Open error: {}", ec.message());
+        return;
+    }
+    acceptor_.set_option(net::socket_base::reuse_address(true), ec);
+    if (ec) {
+        REPEATER_LOG(error, "[Peer Listener] Set option error: {}", ec.message());
+        return;
+    }
+    acceptor_.bind(endpoint, ec);
+    if (ec) {
+        REPEATER_LOG(error, "[Peer Listener] Bind error: {}", ec.message());
+        return;
+    }
+    acceptor_.listen(net::socket_base::max_listen_connections, ec);
+    if (ec) {
+        REPEATER_LOG(error, "[Peer Listener] Listen error: {}", ec.message());
+        return;
+    }
+}
+
+void PeerListener::run() {
+    if (!acceptor_.is_open()) return;
+    if (debug_) {
+        auto const endpoint = acceptor_.local_endpoint();
+        REPEATER_LOG(debug, "[Peer Listener] Listening on {}:{}", endpoint.address().to_string(), endpoint.port());
+    }
+    do_accept();
+}
+
+void PeerListener::do_accept() {
+    acceptor_.async_accept(
+        net::make_strand(ioc_),
+        beast::bind_front_handler(&PeerListener::on_accept, shared_from_this()));
+}
+
+void PeerListener::on_accept(beast::error_code ec, strand_socket socket) {
+    if (ec) {
+        REPEATER_LOG(error, "[Peer Listener] Accept error: {}", ec.message());
+    } else {
+        apply_socket_profile(socket, socket_profile_, "Peer Listener");
+        std::make_shared<PeerConnection>(std::move(socket), shared_from_this())->run();
+    }
+    do_accept();
+}
+
+} // namespace repeater
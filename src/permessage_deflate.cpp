@@ -0,0 +1,158 @@
+#include "repeater/permessage_deflate.hpp"
+#include <boost/beast/core/string.hpp>
+#include <boost/beast/zlib.hpp>
+#include <algorithm>
+#include <charconv>
+
+namespace beast = boost::beast;
+namespace zlib = boost::beast::zlib;
+
+namespace repeater::permessage_deflate {
+
+namespace {
+
+constexpr unsigned char empty_block[4] = {0x00, 0x00, 0xff, 0xff};
+
+// 取出list中第一个separator之前的部分并去掉首尾空白，list前进到separator之后
+std::string_view next_token(std::string_view& list, char separator) {
+    auto const end = list.find(separator);
+    auto token = list.substr(0, end);
+    list = end == std::string_view::npos ? std::string_view{} : list.substr(end + 1);
+    while (!token.empty() && (token.front() == ' ' || token.front() == '\t')) token.remove_prefix(1);
+    while (!token.empty() && (token.back() == ' ' || token.back() == '\t')) token.remove_suffix(1);
+    return token;
+}
+
+beast::string_view to_beast(std::string_view s) {
+    return {s.data(), s.size()};
+}
+
+// 每个广播线程一个压缩器。no_context_takeover下每条消息前reset，不同消息之间没有状态
+struct Deflater {
+    zlib::deflate_stream stream;
+    int level = -1;
+    int window_bits = -1;
+    int mem_level = -1;
+
+    void prepare(const Options& options) {
+        if (level != options.level || window_bits != options.window_bits || mem_level != options.mem_level) {
+            level = options.level;
+            window_bits = options.window_bits;
+            mem_level = options.mem_level;
+            stream.reset(level, window_bits, mem_level, zlib::Strategy::normal);
+        } else {
+            stream.reset();
+        }
+    }
+};
+
+} // namespace
+
+Options Options::from_json(const nlohmann::json& j) {
+    Options o;
+    if (!j.is_object()) return o;
+    o.enabled = j.value("enabled", o.enabled);
+    o.level = std::clamp(j.value("level", o.level), 1, 9);
+    o.window_bits = std::clamp(j.value("window_bits", o.window_bits), 9, 15);
+    o.mem_level = std::clamp(j.value("mem_level", o.mem_level), 1, 9);
+    o.min_size = j.value("min_size", o.min_size);
+    return o;
+}
+
+std::optional<std::string> negotiate(std::string_view offers, const Options& options) {
+    if (!options.enabled) return std::nullopt;
+    // 依次检查客户端的每个提议(逗号分隔)，接受第一个参数都能满足的
+    while (!offers.empty()) {
+        auto offer = next_token(offers, ',');
+        if (!beast::iequals(to_beast(next_token(offer, ';')), "permessage-deflate")) continue;
+        bool acceptable = true;
+        bool server_window = false;
+        bool client_window = false;
+        bool server_takeover = false;
+        bool client_takeover = false;
+        while (acceptable && !offer.empty()) {
+            auto value = next_token(offer, ';');
+            auto const name = to_beast(next_token(value, '='));
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"') value = value.substr(1, value.size() - 2);
+            if (beast::iequals(name, "server_max_window_bits")) {
+                int bits = 0;
+                auto const result = std::from_chars(value.data(), value.data() + value.size(), bits);
+                // 所有会话共享同一个压缩帧，不能为单个客户端缩小窗口
+                acceptable = !server_window && result.ec == std::errc{} && bits >= 8 && bits <= 15 &&
+                             bits >= options.window_bits;
+                server_window = true;
+            } else if (beast::iequals(name, "client_max_window_bits")) {
+                // 解压使用最大窗口，不需要限制客户端
+                acceptable = !client_window;
+                client_window = true;
+            } else if (beast::iequals(name, "server_no_context_takeover")) {
+                acceptable = !server_takeover && value.empty();
+                server_takeover = true;
+            } else if (beast::iequals(name, "client_no_context_takeover")) {
+                acceptable = !client_takeover && value.empty();
+                client_takeover = true;
+            } else {
+                acceptable = false;
+            }
+        }
+        if (!acceptable) continue;
+        // 两个方向都不保留上下文：发出的帧可以共享，收到的消息用任意线程的解压器独立解压
+        std::string response = "permessage-deflate; server_no_context_takeover; client_no_context_takeover";
+        // 客户端提出了server_max_window_bits时总是回应实际使用的窗口，即使是默认的15
+        if (server_window || options.window_bits < 15) {
+            response += "; server_max_window_bits=" + std::to_string(options.window_bits);
+        }
+        return response;
+    }
+    return std::nullopt;
+}
+
+bool compress(std::string_view payload, const Options& options, std::string& out) {
+    thread_local Deflater deflater;
+    deflater.prepare(options);
+
+    out.resize(deflater.stream.upper_bound(payload.size()) + 16);
+    zlib::z_params zs;
+    zs.next_in = payload.data();
+    zs.avail_in = payload.size();
+    zs.next_out = out.data();
+    zs.avail_out = out.size();
+    beast::error_code ec;
+    deflater.stream.write(zs, zlib::Flush::none, ec);
+    if (ec && ec != zlib::error::need_buffers) return false;
+    // 与Beast的permessage-deflate实现相同：先block再full，输出以空的stored块 00 00 ff ff 结尾
+    deflater.stream.write(zs, zlib::Flush::block, ec);
+    if (ec && ec != zlib::error::need_buffers) return false;
+    if (zs.avail_in != 0 || zs.avail_out < 6) return false;
+    deflater.stream.write(zs, zlib::Flush::full, ec);
+    if (ec || zs.total_out < 4) return false;
+    auto const size = zs.total_out - 4;
+    if (!std::equal(empty_block, empty_block + 4, reinterpret_cast<const unsigned char*>(out.data()) + size)) {
+        return false;
+    }
+    out.resize(size);
+    return size < payload.size();
+}
+
+bool decompress(std::string_view payload, std::size_t max_size, std::string& out) {
+    thread_local zlib::inflate_stream inflater;
+    inflater.reset(15);
+
+    out.resize(max_size + 1);
+    zlib::z_params zs;
+    zs.next_out = out.data();
+    zs.avail_out = out.size();
+    beast::error_code ec;
+    for (auto const input : {payload, std::string_view(reinterpret_cast<const char*>(empty_block), 4)}) {
+        zs.next_in = input.data();
+        zs.avail_in = input.size();
+        inflater.write(zs, zlib::Flush::sync, ec);
+        if (ec && ec != zlib::error::need_buffers && ec != zlib::error::end_of_stream) return false;
+        // 多出的一个字节用来发现超长的消息
+        if (zs.total_out > max_size) return false;
+    }
+    out.resize(zs.total_out);
+    return true;
+}
+
+} // namespace repeater::permessage_deflate
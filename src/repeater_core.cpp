@@ -1,76 +1,490 @@
 #include "repeater/repeater_core.hpp"
+#include "repeater/log.hpp"
 #include "repeater/websocket_client.hpp"
 #include "repeater/websocket_server.hpp"
 #include "repeater/message_processor.hpp"
+#include "repeater/message_pool.hpp"
+#include "repeater/peer_link.hpp"
+#include "repeater/runtime_profile.hpp"
+#include "repeater/socket_profile.hpp"
+#include "repeater/control_server.hpp"
+#include "repeater/subscription_manager.hpp"
+#include "repeater/trace.hpp"
 
 #include <boost/asio/signal_set.hpp>
-#include <iostream>
+#include <boost/asio/steady_timer.hpp>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <latch>
+#include <sstream>
 #include <thread>
+#include <unistd.h>
 
 namespace repeater {
 
-RepeaterCore::RepeaterCore(const nlohmann::json& config)
-    : config_(config), debug_(config.value("debug", false)) {}
+namespace {
+
+ControlServer::Response json_response(http::status status, const nlohmann::json& body) {
+    ControlServer::Response res{status, 11};
+    res.set(http::field::content_type, "application/json");
+    res.body() = body.dump();
+    return res;
+}
+
+ControlServer::Response error_response(http::status status, const std::string& message) {
+    return json_response(status, {{"error", message}});
+}
+
+/**
+ * 上游连接的sink：把每条消息连同来源id交给MessageProcessor，调用在客户端的读循环中内联。
+ */
+struct ProcessorSink {
+    MessageProcessor* processor;
+    int source_id;
+
+    void operator()(std::string_view message) const { processor->process(message, source_id); }
+};
+
+/**
+ * 进程当前的常驻内存(RSS)，读取失败时返回0。
+ */
+std::size_t resident_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    std::size_t total_pages = 0;
+    std::size_t resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages)) return 0;
+    return resident_pages * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+/**
+ * 预热：用合成的订单簿和成交消息走一遍提取、去重、消息池和广播路径。
+ * 每条消息处理两次(模拟两条冗余的上游连接)，转发和丢弃两个分支都会被执行。
+ */
+void run_warmup(MessageProcessor& processor, std::size_t thread_index, std::size_t count) {
+    // 预热的流随预热处理器一起释放，不占用为真实流预留的区域
+    HotArenaBypass const bypass;
+    std::string message;
+    message.reserve(512);
+    auto const base = static_cast<long long>(thread_index * count);
+    for (std::size_t i = 1; i <= count; ++i) {
+        auto const key = std::to_string(base + static_cast<long long>(i));
+        if (i % 2) {
+            message = R"({"arg":{"channel":"bbo-tbt","instId":"WARMUP-USDT"},"data":[{"asks":[["100.1","1","0","1"]],)"
+                      R"("bids":[["100.0","1","0","1"]],"ts":"1","seqId":)" + key + "}]}";
+        } else {
+            message = R"({"arg":{"channel":"trades","instId":"WARMUP-USDT"},"data":[{"instId":"WARMUP-USDT","tradeId":")" +
+                      key + R"(","px":"100.0","sz":"1","side":"buy","ts":"1"}]})";
+        }
+        processor.process(message, 1);
+        processor.process(message, 2);
+    }
+}
+
+/**
+ * 配置中的上游分组。没有 "feeds" 时，顶层的okx_connections和subscription_message组成名为 "default" 的唯一一组；
+ * 没有 "name" 的组按位置命名为 "feed 1"、"feed 2"...
+ */
+nlohmann::json feed_configs(const nlohmann::json& config) {
+    if (!config.contains("feeds")) {
+        return nlohmann::json::array({{{"name", "default"},
+                                       {"okx_connections", config.value("okx_connections", nlohmann::json::array())},
+                                       {"subscription_message", config.value("subscription_message", nlohmann::json::object())}}});
+    }
+    auto feeds = config["feeds"];
+    for (std::size_t i = 0; i < feeds.size(); ++i) {
+        if (!feeds[i].contains("name")) feeds[i]["name"] = "feed " + std::to_string(i + 1);
+    }
+    return feeds;
+}
+
+const nlohmann::json* find_feed(const nlohmann::json& feeds, const std::string& name) {
+    for (auto const& feed : feeds) {
+        if (feed["name"] == name) return &feed;
+    }
+    return nullptr;
+}
+
+std::vector<std::string> feed_urls(const nlohmann::json& feed) {
+    return feed.value("okx_connections", std::vector<std::string>{});
+}
+
+nlohmann::json feed_pinned_args(const nlohmann::json& feed) {
+    return feed.value("subscription_message", nlohmann::json::object()).value("args", nlohmann::json::array());
+}
+
+bool channel_matches(const std::string& pattern, std::string_view channel) {
+    if (!pattern.empty() && pattern.back() == '*') {
+        return channel.substr(0, pattern.size() - 1) == std::string_view(pattern).substr(0, pattern.size() - 1);
+    }
+    return channel == pattern;
+}
+
+std::string session_event(const char* event, const nlohmann::json& arg) {
+    return nlohmann::json{{"event", event}, {"arg", arg}}.dump();
+}
+
+std::string session_error(const std::string& message) {
+    return nlohmann::json{{"event", "error"}, {"code", "60012"}, {"msg", message}}.dump();
+}
+
+// 校验请求中的每个arg，并转换为会话过滤投递使用的流选择器
+std::vector<StreamSelector> selectors_of(const nlohmann::json& args) {
+    std::vector<StreamSelector> selectors;
+    for (auto const& arg : args) {
+        SubscriptionManager::validate(arg);
+        selectors.push_back(StreamSelector{arg["channel"].get<std::string>(), arg.value("instId", std::string{})});
+    }
+    return selectors;
+}
+
+} // namespace
+
+RepeaterCore::RepeaterCore(const nlohmann::json& config, std::string config_path)
+    : config_(config), config_path_(std::move(config_path)), debug_(config.value("debug", false)) {}
+
+RepeaterCore::~RepeaterCore() = default;
 
 void RepeaterCore::run() {
     // 1. 获取配置
     auto const server_host = net::ip::make_address(config_["repeater_server"]["host"].get<std::string>());
     auto const server_port = config_["repeater_server"]["port"].get<unsigned short>();
-    auto const okx_urls = config_["okx_connections"].get<std::vector<std::string>>();
-    auto const sub_message = config_["subscription_message"].dump();
+    auto const feeds = feed_configs(config_);
     auto const threads = config_.value("threads", 1);
+    auto const pool_config = config_.value("message_pool", nlohmann::json::object());
+    auto const pool_slot_size = pool_config.value("slot_size", std::size_t{16384});
+    auto const pool_slot_count = pool_config.value("slot_count", std::size_t{4096});
+    auto const federation = config_.value("federation", nlohmann::json::object());
+    auto const node_id = federation.value("node_id", std::uint32_t{0});
+    auto const telemetry_interval = config_.value("telemetry_interval_sec", 0);
+    auto const batch_window = std::chrono::milliseconds(
+        config_.value("subscription_manager", nlohmann::json::object()).value("batch_window_ms", 20));
+    socket_profile_ = SocketProfile::from_json(config_.value("socket_profile", nlohmann::json::object()));
+    auto const replay_depth = config_.value("replay", nlohmann::json::object()).value("depth", std::size_t{0});
+    // 日志的后台线程最先启动，之后所有线程的记录都经过它格式化写出
+    log::configure(log::Options::from_json(config_.value("log", nlohmann::json::object()), debug_));
+    auto const trace_options = trace::Options::from_json(config_.value("trace", nlohmann::json::object()));
+    trace::configure(trace_options);
+    auto const runtime = RuntimeProfile::from_json(config_.value("runtime_profile", nlohmann::json::object()));
+    // 进程级的内存设置必须先于消息池和去重表的分配
+    apply_process_profile(runtime);
+    if (runtime.huge_pages || runtime.prefault) configure_hot_arena(runtime);
 
     if (debug_) {
-        std::cout << "[Core] Starting with " << threads << " I/O threads." << std::endl;
-        std::cout << "[Core] Subscription message: " << sub_message << std::endl;
+        REPEATER_LOG(info, "[Core] Starting with {} I/O threads.", threads);
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+        REPEATER_LOG(info, "[Core] I/O backend: io_uring");
+#else
+        REPEATER_LOG(info, "[Core] I/O backend: epoll");
+#endif
+        if (trace_options.enabled) {
+            REPEATER_LOG(info, "[Core] Hot-path tracing enabled, dump threshold {}us, dumps go to {}",
+                         trace_options.threshold_us, trace_options.dump_dir);
+        }
     }
 
-    // 2. 初始化IO上下文和SSL上下文
-    net::io_context ioc{static_cast<int>(threads)};
-    ssl::context ctx{ssl::context::tlsv12_client};
-    ctx.set_default_verify_paths();
-    ctx.set_verify_mode(ssl::verify_peer);
+    // 启动报告：内核实际授予的socket参数(例如SO_RCVBUF会被内核翻倍或被rmem_max截断)
+    REPEATER_LOG(info, "[Core] Socket profile granted by kernel: {}",
+                 probe_socket_profile(socket_profile_).to_string());
+
+    // 2. 初始化消息缓冲池、IO上下文和SSL上下文
+    // 缓冲池必须先于io_context构造：关闭时io_context中残留的handler仍可能持有池中的缓冲区
+    pool_ = std::make_unique<MessagePool>(pool_slot_size, pool_slot_count, runtime);
+    ioc_ = std::make_unique<net::io_context>(static_cast<int>(threads));
+    ssl_ctx_ = std::make_unique<ssl::context>(ssl::context::tlsv12_client);
+    ssl_ctx_->set_default_verify_paths();
+    ssl_ctx_->set_verify_mode(ssl::verify_peer);
+    auto& ioc = *ioc_;
+
+    // 上游分组：threads大于0的组使用自己的io_context，配置了message_pool的组使用自己的池
+    std::size_t total_urls = 0;
+    int feed_threads = 0;
+    for (auto const& feed_config : feeds) {
+        Feed feed;
+        feed.name = feed_config["name"].get<std::string>();
+        for (auto const& other : feeds_) {
+            if (other.name == feed.name) throw std::invalid_argument("Duplicate feed name: " + feed.name);
+        }
+        feed.channels = feed_config.value("channels", std::vector<std::string>{});
+        feed.threads = std::max(feed_config.value("threads", 0), 0);
+        feed.cpus = feed_config.value("cpus", std::vector<int>{});
+        if (feed.threads > 0) feed.ioc = std::make_unique<net::io_context>(feed.threads);
+        feed.pool = pool_.get();
+        if (feed_config.contains("message_pool")) {
+            auto const& feed_pool = feed_config["message_pool"];
+            feed_pools_.push_back(std::make_unique<MessagePool>(feed_pool.value("slot_size", pool_slot_size),
+                                                                feed_pool.value("slot_count", pool_slot_count), runtime));
+            feed.pool = feed_pools_.back().get();
+        }
+        total_urls += feed_urls(feed_config).size();
+        feed_threads += feed.threads;
+        if (debug_) {
+            REPEATER_LOG(info, "[Core] Feed '{}': {} connections, {} threads, {} message pool, pinned {}", feed.name,
+                         feed_urls(feed_config).size(), feed.threads, feed.pool == pool_.get() ? "shared" : "dedicated",
+                         feed_pinned_args(feed_config).dump());
+        }
+        feeds_.push_back(std::move(feed));
+    }
+
+    // 续传缓冲区中每个流最多占用replay_depth个槽位，这些槽位来自流所在组的池。
+    // 按固定订阅估计流的数量(会话订阅的流会更多)，池容纳不下时，突发期间的消息只能在堆上分配
+    if (replay_depth > 0) {
+        std::map<MessagePool*, std::size_t> pool_streams;
+        for (std::size_t i = 0; i < feeds_.size(); ++i) {
+            pool_streams[feeds_[i].pool] += feed_pinned_args(feeds[i]).size();
+        }
+        for (auto const& [pool, streams] : pool_streams) {
+            if (replay_depth * streams > pool->slot_count()) {
+                REPEATER_LOG(warn, "[Core] replay.depth {} x {} pinned streams exceeds message_pool slot_count {}; "
+                             "raise slot_count or lower replay.depth", replay_depth, streams, pool->slot_count());
+            }
+        }
+    }
+
+    // 下游会话的优先级层级，从高到低；"threads"大于0的层级使用自己的io_context和线程
+    std::vector<SessionTier> tiers;
+    std::vector<int> tier_threads;
+    for (auto const& tier : config_["repeater_server"].value("tiers", nlohmann::json::array())) {
+        auto const name = tier.is_string() ? tier.get<std::string>() : tier["name"].get<std::string>();
+        auto const count = tier.is_object() ? tier.value("threads", 0) : 0;
+        net::io_context* context = nullptr;
+        if (count > 0) {
+            tier_iocs_.push_back(std::make_unique<net::io_context>(count));
+            tier_threads.push_back(count);
+            context = tier_iocs_.back().get();
+        }
+        tiers.push_back(SessionTier{name, context});
+        tier_names_.push_back(name);
+    }
+    if (tiers.empty()) {
+        tiers.push_back(SessionTier{"default", nullptr});
+        tier_names_.push_back("default");
+    }
+    auto const default_tier_name = config_["repeater_server"].value("default_tier", tier_names_.back());
+    auto const default_tier = static_cast<std::size_t>(
+        std::find(tier_names_.begin(), tier_names_.end(), default_tier_name) - tier_names_.begin());
+    if (default_tier == tier_names_.size()) {
+        REPEATER_LOG(error, "[Core] Unknown default_tier '{}', using '{}'", default_tier_name, tier_names_.back());
+    }
+    if (debug_) {
+        std::string names;
+        for (auto const& tier : tiers) {
+            names += " " + tier.name + (tier.context ? "(dedicated)" : "");
+        }
+        REPEATER_LOG(info, "[Core] Session tiers (highest first):{}, default '{}'", names,
+                     tier_names_[std::min(default_tier, tier_names_.size() - 1)]);
+    }
 
     // 3. 创建核心组件
-    auto server = std::make_shared<WebSocketServer>(ioc, tcp::endpoint{server_host, server_port}, debug_);
-    
-    auto processor_callback = [&](std::string_view msg) {
-        server->broadcast(msg);
+    server_ = std::make_shared<WebSocketServer>(ioc, tcp::endpoint{server_host, server_port}, socket_profile_, *pool_,
+                                                replay_depth, debug_);
+    server_->set_tiers(std::move(tiers), default_tier);
+    auto const compression = permessage_deflate::Options::from_json(
+        config_["repeater_server"].value("permessage_deflate", nlohmann::json::object()));
+    server_->set_compression(compression);
+    if (debug_ && compression.enabled) {
+        REPEATER_LOG(info, "[Core] permessage-deflate enabled (level {}, window {}, min_size {})", compression.level,
+                     compression.window_bits, compression.min_size);
+    }
+
+    // 来源id: 上游连接从1开始向上分配，联邦对端从max_sources-1开始向下分配，
+    // 这样运行期间新增的上游连接不会与对端的id冲突。只有本地上游赢得的消息才会转发给对端，
+    // 从对端收到的消息不再转发，避免在节点之间形成环路。
+    source_names_.assign(MessageProcessor::max_sources, std::string{});
+    source_feeds_.assign(MessageProcessor::max_sources, 0);
+    source_pools_ = std::vector<std::atomic<MessagePool*>>(MessageProcessor::max_sources);
+    for (auto& pool : source_pools_) pool.store(pool_.get(), std::memory_order_relaxed);
+    lowest_peer_source_ = MessageProcessor::max_sources;
+
+    std::unordered_map<std::uint32_t, int> peer_sources;
+    if (federation.contains("peers")) {
+        for (auto const& peer : federation["peers"]) {
+            auto const peer_node = peer["node_id"].get<std::uint32_t>();
+            auto const address = peer["address"].get<std::string>();
+            if (lowest_peer_source_ - 1 <= static_cast<int>(total_urls)) {
+                REPEATER_LOG(error, "[Core] Too many sources, ignoring peer node {}", peer_node);
+                continue;
+            }
+            --lowest_peer_source_;
+            peers_.emplace_back(std::make_shared<PeerSender>(ioc, address, node_id, socket_profile_, debug_));
+            peer_sources.emplace(peer_node, lowest_peer_source_);
+            source_names_[lowest_peer_source_] = "Peer " + std::to_string(peer_node);
+        }
+    }
+
+    auto processor_callback = [this](const ForwardedMessage& msg) {
+        // 消息放入赢得竞争的来源所在组的池；联邦对端的消息使用共享的池
+        auto* const pool = msg.source_id >= 0 && msg.source_id < MessageProcessor::max_sources
+            ? source_pools_[msg.source_id].load(std::memory_order_relaxed) : pool_.get();
+        auto const local = pool->acquire(msg.local_payload);
+        server_->broadcast(local, msg);
+        if (msg.source_id < lowest_peer_source_ && !peers_.empty()) {
+            // 对端收到原始消息；没有被标记时与本地共享同一个缓冲区
+            auto const original = msg.local_payload.data() == msg.payload.data() ? local : pool->acquire(msg.payload);
+            for (auto const& peer : peers_) {
+                peer->publish(original);
+            }
+        }
     };
-    auto processor = std::make_shared<MessageProcessor>(processor_callback, debug_);
+    auto const stale_guard = StaleGuardOptions::from_json(config_.value("stale_guard", nlohmann::json::object()));
+    processor_ = std::make_shared<MessageProcessor>(processor_callback, debug_,
+        MessageProcessor::parse_overrides(config_.value("dedup_policies", nlohmann::json::object())), stale_guard);
+    if (debug_ && stale_guard.max_age_us > 0) {
+        REPEATER_LOG(info, "[Core] Stale guard: {} messages more than {}ms behind the fastest path",
+                     stale_guard.drop ? "dropping" : "flagging", stale_guard.max_age_us / 1000);
+    }
+    // 按channel的覆盖在全局上限为0时同样生效，逐条列出
+    for (auto const& [channel, max_age_us] : stale_guard.channel_max_age_us) {
+        if (debug_ && max_age_us > 0) {
+            REPEATER_LOG(info, "[Core] Stale guard: {} {} messages more than {}ms behind the fastest path",
+                         stale_guard.drop ? "dropping" : "flagging", channel, max_age_us / 1000);
+        }
+    }
 
-    std::vector<std::shared_ptr<WebSocketClient>> clients;
-    int client_id = 0;
-    for (const auto& url : okx_urls) {
-        auto client_callback = [processor](const std::string& msg) {
-            processor->process(msg);
-        };
-        clients.emplace_back(std::make_shared<WebSocketClient>(ioc, ctx, url, sub_message, client_callback, debug_, ++client_id));
+    // 每组上游订阅的每次批量变更：新流先注册去重策略，再把增量op发给本组的上游连接并更新其重连订阅
+    for (std::size_t i = 0; i < feeds_.size(); ++i) {
+        auto& feed = feeds_[i];
+        feed.subscriptions = std::make_unique<SubscriptionManager>(feed.ioc ? *feed.ioc : ioc, batch_window,
+            [this, i](const SubscriptionUpdate& update) {
+                processor_->register_subscriptions(update.subscribed);
+                std::lock_guard<std::mutex> lock(control_mutex_);
+                for (auto const& [id, client] : clients_) {
+                    if (source_feeds_[id] != i) continue;
+                    for (auto const& op : update.ops) client->send(op);
+                    client->set_subscription(update.replay);
+                }
+            }, debug_);
+        feed.subscriptions->pin(feed_pinned_args(feeds[i]));
+    }
+
+    server_->set_session_handlers(
+        [this](std::uint64_t session_id, std::string_view message) {
+            return handle_session_request(session_id, message);
+        },
+        [this](std::uint64_t session_id) {
+            for (auto const& feed : feeds_) feed.subscriptions->release_all(session_id);
+        });
+
+    std::shared_ptr<PeerListener> peer_listener;
+    if (federation.contains("listen")) {
+        auto const listen_host = net::ip::make_address(federation["listen"]["host"].get<std::string>());
+        auto const listen_port = federation["listen"]["port"].get<unsigned short>();
+        peer_listener = std::make_shared<PeerListener>(ioc, tcp::endpoint{listen_host, listen_port}, node_id, peer_sources,
+            [processor = processor_](std::string_view msg, int source_id) { processor->process(msg, source_id); },
+            socket_profile_, debug_);
+    }
+
+    std::shared_ptr<ControlServer> control;
+    if (config_.contains("control")) {
+        auto const control_host = net::ip::make_address(config_["control"]["host"].get<std::string>());
+        auto const control_port = config_["control"]["port"].get<unsigned short>();
+        control = std::make_shared<ControlServer>(ioc, tcp::endpoint{control_host, control_port},
+            [this](const ControlServer::Request& req) { return handle_control(req); }, debug_);
     }
 
     // 4. 启动所有组件
-    server->run();
-    for (auto& client : clients) {
-        client->run();
+    server_->run();
+    if (peer_listener) peer_listener->run();
+    for (auto& peer : peers_) {
+        peer->run();
+    }
+    {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        for (std::size_t i = 0; i < feeds_.size(); ++i) {
+            for (const auto& url : feed_urls(feeds[i])) add_connection(url, i);
+        }
+    }
+    if (control) control->run();
+
+    // 定期打印每个来源(上游连接/联邦对端)赢得竞争的次数
+    net::steady_timer telemetry_timer(ioc);
+    std::function<void()> schedule_telemetry = [&] {
+        telemetry_timer.expires_after(std::chrono::seconds(telemetry_interval));
+        telemetry_timer.async_wait([&](beast::error_code ec) {
+            if (ec) return;
+            REPEATER_LOG(info, "{}", wins_report());
+            schedule_telemetry();
+        });
+    };
+    if (telemetry_interval > 0) {
+        schedule_telemetry();
     }
 
     // 5. 设置信号处理，优雅地关闭
     net::signal_set signals(ioc, SIGINT, SIGTERM);
     signals.async_wait([&](auto, auto){
-        if (debug_) std::cout << "[Core] Signal received, shutting down." << std::endl;
+        if (debug_) REPEATER_LOG(debug, "[Core] Signal received, shutting down.");
         ioc.stop();
+        for (auto& tier_ioc : tier_iocs_) tier_ioc->stop();
+        for (auto& feed : feeds_) {
+            if (feed.ioc) feed.ioc->stop();
+        }
     });
 
     // 6. 启动线程池运行io_context
+    // 每个I/O线程先绑核、预写栈并处理一段合成消息，全部完成后才开始服务，
+    // 在此之前不会接受任何下游连接，也不会处理上游的连接和数据
+    std::unique_ptr<MessageProcessor> warmup;
+    if (runtime.warmup_messages > 0) {
+        // 不带来源的broadcast不写入续传缓冲区，合成的WARMUP流不会出现在续传中
+        warmup = std::make_unique<MessageProcessor>([this](const ForwardedMessage& msg) {
+            server_->broadcast(pool_->acquire(msg.local_payload));
+        }, false);
+    }
+    std::latch ready(threads + feed_threads);
+    auto const warmup_start = std::chrono::steady_clock::now();
     std::vector<std::thread> thread_pool;
-    thread_pool.reserve(threads);
+    thread_pool.reserve(threads + feed_threads);
     for(int i = 0; i < threads; ++i) {
-        thread_pool.emplace_back([&ioc] {
+        thread_pool.emplace_back([&ioc, &runtime, &warmup, &ready, i] {
+            prepare_io_thread(runtime, static_cast<std::size_t>(i));
+            if (warmup) run_warmup(*warmup, static_cast<std::size_t>(i), runtime.warmup_messages);
+            ready.arrive_and_wait();
             ioc.run();
         });
     }
+    // 有专用线程的组：配置了cpus时绑定到这些CPU，否则与共享线程一样按序号使用io_cpus。
+    // 在没有上游连接时也要保持运行，运行期间可以通过控制接口为它添加连接
+    std::vector<net::executor_work_guard<net::io_context::executor_type>> feed_work;
+    for (auto& feed : feeds_) {
+        if (!feed.ioc) continue;
+        feed_work.push_back(net::make_work_guard(*feed.ioc));
+        auto profile = runtime;
+        if (!feed.cpus.empty()) profile.io_cpus = feed.cpus;
+        for (int t = 0; t < feed.threads; ++t) {
+            auto const index = thread_pool.size();
+            auto const cpu_index = feed.cpus.empty() ? index : static_cast<std::size_t>(t);
+            thread_pool.emplace_back([&feed_ioc = *feed.ioc, profile, &warmup, &ready, index, cpu_index] {
+                prepare_io_thread(profile, cpu_index);
+                if (warmup) run_warmup(*warmup, index, profile.warmup_messages);
+                ready.arrive_and_wait();
+                feed_ioc.run();
+            });
+        }
+    }
+    ready.wait();
+    if (warmup) {
+        warmup.reset();
+        auto const warmup_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - warmup_start).count();
+        REPEATER_LOG(info, "[Core] Warm-up: {} messages per I/O thread in {} ms, message pool overflow {}",
+                     runtime.warmup_messages, warmup_ms, pool_->overflow_count());
+    }
+    // 专用层级在没有会话时也要保持运行
+    std::vector<net::executor_work_guard<net::io_context::executor_type>> tier_work;
+    for (std::size_t i = 0; i < tier_iocs_.size(); ++i) {
+        auto& tier_ioc = *tier_iocs_[i];
+        tier_work.push_back(net::make_work_guard(tier_ioc));
+        for (int t = 0; t < tier_threads[i]; ++t) {
+            auto const index = thread_pool.size();
+            thread_pool.emplace_back([&tier_ioc, &runtime, index] {
+                prepare_io_thread(runtime, index);
+                tier_ioc.run();
+            });
+        }
+    }
 
-    if (debug_) std::cout << "[Core] Repeater is running. Press Ctrl+C to exit." << std::endl;
+    if (debug_) REPEATER_LOG(info, "[Core] Repeater is running. Press Ctrl+C to exit.");
 
     // 等待所有线程完成
     for(auto& t : thread_pool) {
@@ -79,7 +493,337 @@ void RepeaterCore::run() {
         }
     }
 
-    if (debug_) std::cout << "[Core] Shutdown complete." << std::endl;
+    trace::shutdown();
+
+    if (debug_) {
+        REPEATER_LOG(info, "{}", wins_report());
+        REPEATER_LOG(info, "[Core] Shutdown complete. Message pool overflow allocations: {}", pool_->overflow_count());
+    }
+    log::shutdown();
+}
+
+std::string RepeaterCore::wins_report() {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    std::ostringstream os;
+    os << "[Core] Wins by source:";
+    for (int id = 0; id < MessageProcessor::max_sources; ++id) {
+        if (!source_names_[id].empty()) os << " " << source_names_[id] << "=" << processor_->wins(id);
+    }
+    return os.str();
+}
+
+std::size_t RepeaterCore::feed_for(const nlohmann::json& arg) const {
+    // 已被某一组固定的arg由该组的连接提供，不会在另一组重复订阅
+    for (std::size_t i = 0; i < feeds_.size(); ++i) {
+        for (auto const& pinned : feeds_[i].subscriptions->pinned()) {
+            if (SubscriptionManager::same_arg(pinned, arg)) return i;
+        }
+    }
+    auto const channel = arg.is_object() ? arg.value("channel", std::string{}) : std::string{};
+    for (std::size_t i = 0; i < feeds_.size(); ++i) {
+        for (auto const& pattern : feeds_[i].channels) {
+            if (channel_matches(pattern, channel)) return i;
+        }
+    }
+    for (std::size_t i = 0; i < feeds_.size(); ++i) {
+        if (feeds_[i].channels.empty()) return i;
+    }
+    return 0;
+}
+
+int RepeaterCore::add_connection(const std::string& url, std::size_t feed_index) {
+    // 复用最小的空闲id；复用前清零该id的胜出计数和延迟统计，新连接不继承已移除连接的数据
+    int id = 1;
+    while (clients_.count(id)) ++id;
+    if (id >= lowest_peer_source_) {
+        REPEATER_LOG(error, "[Core] Too many sources, ignoring connection {}", url);
+        return -1;
+    }
+    processor_->reset_source(id);
+
+    // OKX使用wss://；ws://地址(例如本地的模拟行情源)使用明文传输。连接在所属组的io_context上读取和处理消息
+    auto& feed = feeds_[feed_index];
+    auto& context = feed.ioc ? *feed.ioc : *ioc_;
+    std::shared_ptr<WebSocketClient> client;
+    if (url.rfind(PlainTransport::scheme, 0) == 0) {
+        client = make_websocket_client(context, PlainTransport{}, url, feed.subscriptions->replay_messages(),
+            ProcessorSink{processor_.get(), id}, socket_profile_, debug_, id);
+    } else {
+        client = make_websocket_client(context, TlsTransport{*ssl_ctx_}, url, feed.subscriptions->replay_messages(),
+            ProcessorSink{processor_.get(), id}, socket_profile_, debug_, id);
+    }
+    clients_.emplace(id, client);
+    source_names_[id] = "Client " + std::to_string(id);
+    source_feeds_[id] = feed_index;
+    source_pools_[id].store(feed.pool, std::memory_order_relaxed);
+    client->run();
+    if (debug_) REPEATER_LOG(debug, "[Core] Added connection {} to feed '{}': {}", id, feed.name, url);
+    return id;
+}
+
+bool RepeaterCore::remove_connection(int id) {
+    auto it = clients_.find(id);
+    if (it == clients_.end()) return false;
+    it->second->stop();
+    clients_.erase(it);
+    source_names_[id].clear();
+    if (debug_) REPEATER_LOG(debug, "[Core] Removed connection {}", id);
+    return true;
+}
+
+nlohmann::json RepeaterCore::status() {
+    auto connections = nlohmann::json::array();
+    for (auto const& [id, client] : clients_) {
+        connections.push_back({{"id", id}, {"url", client->url()}, {"feed", feeds_[source_feeds_[id]].name}});
+    }
+    auto subscriptions = nlohmann::json::array();
+    auto feeds = nlohmann::json::object();
+    for (auto const& feed : feeds_) {
+        for (auto entry : feed.subscriptions->status()) {
+            entry["feed"] = feed.name;
+            subscriptions.push_back(std::move(entry));
+        }
+        feeds[feed.name] = {{"threads", feed.threads},
+                            {"cpus", feed.cpus},
+                            {"message_pool", {{"dedicated", feed.pool != pool_.get()},
+                                              {"in_use", feed.pool->in_use()},
+                                              {"overflow", feed.pool->overflow_count()}}}};
+    }
+    auto tiers = nlohmann::json::object();
+    auto const tier_counts = server_->tier_session_counts();
+    for (std::size_t i = 0; i < tier_counts.size(); ++i) tiers[tier_names_[i]] = tier_counts[i];
+    auto wins = nlohmann::json::object();
+    auto latency = nlohmann::json::object();
+    for (int id = 0; id < MessageProcessor::max_sources; ++id) {
+        if (source_names_[id].empty()) continue;
+        wins[source_names_[id]] = processor_->wins(id);
+        auto const source = processor_->clock().source(id);
+        latency[source_names_[id]] = {{"min_us", source.min_us}, {"avg_us", source.avg_us}, {"samples", source.samples}};
+    }
+    auto peers = nlohmann::json::array();
+    for (auto const& peer : peers_) peers.push_back({{"address", peer->address()}, {"dropped", peer->dropped()}});
+    auto const offset = processor_->clock().offset_us();
+    auto const compression = server_->compression_stats();
+    return {{"connections", connections},
+            {"subscriptions", subscriptions},
+            {"feeds", feeds},
+            {"sessions", server_->session_count()},
+            {"tiers", tiers},
+            {"compression", {{"sessions", compression.sessions},
+                             {"messages", compression.messages},
+                             {"bytes_in", compression.bytes_in},
+                             {"bytes_out", compression.bytes_out}}},
+            {"wins", wins},
+            {"peers", peers},
+            {"clock", {{"offset_us", offset ? nlohmann::json(*offset) : nlohmann::json()},
+                       {"stale", processor_->stale_count()},
+                       {"one_way_latency", latency}}},
+            {"message_pool", {{"in_use", pool_->in_use()}, {"overflow", pool_->overflow_count()}}},
+            {"log_dropped", log::dropped()},
+            {"rss_bytes", resident_bytes()}};
+}
+
+nlohmann::json RepeaterCore::reload() {
+    if (config_path_.empty()) throw std::runtime_error("no config path");
+    std::ifstream config_file(config_path_);
+    if (!config_file.is_open()) throw std::runtime_error("could not open " + config_path_);
+    nlohmann::json next;
+    config_file >> next;
+
+    // 先校验整份新配置再做差分，避免应用了一部分变更之后才因为后面的组出错而抛出
+    auto const next_feeds = feed_configs(next);
+    for (auto const& next_feed : next_feeds) {
+        if (!next_feed["name"].is_string()) throw std::invalid_argument("feed name must be a string");
+        feed_urls(next_feed);
+        auto const args = feed_pinned_args(next_feed);
+        if (!args.is_array()) throw std::invalid_argument("subscription_message.args must be an array");
+        for (auto const& arg : args) SubscriptionManager::validate(arg);
+    }
+
+    // 各组按名称对应，组内的连接和固定订阅分别做差分。
+    // 组的增删以及threads、cpus、channels、message_pool的变化影响已经创建的线程和池，只能在重启时生效
+    auto const current_feeds = feed_configs(config_);
+    auto const layout = [](nlohmann::json feed) {
+        feed.erase("okx_connections");
+        feed.erase("subscription_message");
+        return feed;
+    };
+    bool feeds_changed = current_feeds.size() != next_feeds.size();
+    auto added = nlohmann::json::array();
+    auto removed = nlohmann::json::array();
+    auto pinned = nlohmann::json::array();
+    auto unpinned = nlohmann::json::array();
+    for (auto const& next_feed : next_feeds) {
+        auto const name = next_feed["name"].get<std::string>();
+        auto const* current_feed = find_feed(current_feeds, name);
+        auto const feed = std::find_if(feeds_.begin(), feeds_.end(), [&](const Feed& f) { return f.name == name; });
+        if (!current_feed || feed == feeds_.end()) {
+            feeds_changed = true;
+            continue;
+        }
+        if (layout(*current_feed) != layout(next_feed)) feeds_changed = true;
+        auto const index = static_cast<std::size_t>(feed - feeds_.begin());
+
+        // 上游连接按URL做多重集合差分：同一URL可以配置多条冗余连接
+        auto wanted = feed_urls(next_feed);
+        std::vector<int> to_remove;
+        for (auto const& [id, client] : clients_) {
+            if (source_feeds_[id] != index) continue;
+            auto it = std::find(wanted.begin(), wanted.end(), client->url());
+            if (it != wanted.end()) {
+                wanted.erase(it);
+            } else {
+                to_remove.push_back(id);
+            }
+        }
+        for (int id : to_remove) {
+            removed.push_back(id);
+            remove_connection(id);
+        }
+        for (auto const& url : wanted) {
+            auto const id = add_connection(url, index);
+            if (id > 0) added.push_back(id);
+        }
+
+        // 固定订阅按arg做差分；会话请求的订阅不受影响
+        auto const next_args = feed_pinned_args(next_feed);
+        auto stale = nlohmann::json::array();
+        for (auto const& arg : feed->subscriptions->pinned()) {
+            bool wanted_arg = false;
+            for (auto const& candidate : next_args) {
+                if (SubscriptionManager::same_arg(arg, candidate)) wanted_arg = true;
+            }
+            if (!wanted_arg) stale.push_back(arg);
+        }
+        for (auto const& arg : feed->subscriptions->unpin(stale)) unpinned.push_back(arg);
+        for (auto const& arg : feed->subscriptions->pin(next_args)) pinned.push_back(arg);
+
+        // 只把已经应用的两项写回config_：feeds_与feed_configs(config_)的顺序一致
+        auto& applied = config_.contains("feeds") ? config_["feeds"][index] : config_;
+        for (auto const* key : {"okx_connections", "subscription_message"}) {
+            if (next_feed.contains(key)) {
+                applied[key] = next_feed[key];
+            } else {
+                applied.erase(key);
+            }
+        }
+    }
+
+    // 这些配置项影响已经创建的监听socket、线程池或全局状态，只能在重启时生效。
+    // config_中保留的是正在使用的值，未生效的变更在之后每次reload时都会继续列出
+    auto ignored = nlohmann::json::array();
+    for (auto const* key : {"repeater_server", "threads", "socket_profile", "message_pool", "federation",
+                            "control", "dedup_policies", "subscription_manager", "debug", "telemetry_interval_sec", "trace", "replay",
+                            "runtime_profile", "stale_guard", "log"}) {
+        if (config_.value(key, nlohmann::json{}) != next.value(key, nlohmann::json{})) ignored.push_back(key);
+    }
+    if (feeds_changed) ignored.push_back("feeds");
+
+    return {{"connections_added", added},
+            {"connections_removed", removed},
+            {"pinned", pinned},
+            {"unpinned", unpinned},
+            {"requires_restart", ignored}};
+}
+
+SessionResponse RepeaterCore::handle_session_request(std::uint64_t session_id, std::string_view message) {
+    // 下游会话使用与OKX相同的协议：{"op":"subscribe"|"unsubscribe","args":[...]}，以及文本心跳 "ping"
+    if (message == "ping") return {{"pong"}};
+
+    SessionResponse response;
+    try {
+        auto const request = nlohmann::json::parse(message);
+        auto const op = request.value("op", std::string{});
+        auto const args = request.value("args", nlohmann::json::array());
+        if (!args.is_array() || args.empty()) return {{session_error("args must be a non-empty array")}};
+
+        if (op == "subscribe") {
+            // 每个arg由一组上游提供；先校验全部arg，避免请求只在部分组中生效
+            auto selectors = selectors_of(args);
+            std::vector<nlohmann::json> routed(feeds_.size(), nlohmann::json::array());
+            for (auto const& arg : args) routed[feed_for(arg)].push_back(arg);
+            for (std::size_t i = 0; i < feeds_.size(); ++i) {
+                if (!routed[i].empty()) feeds_[i].subscriptions->acquire(session_id, routed[i]);
+            }
+            response.subscribed = std::move(selectors);
+        } else if (op == "unsubscribe") {
+            auto selectors = selectors_of(args);
+            // 会话只在订阅时所在的组中持有引用，其它组忽略这些arg
+            for (auto const& feed : feeds_) feed.subscriptions->release(session_id, args);
+            response.unsubscribed = std::move(selectors);
+        } else {
+            return {{session_error("unsupported op: " + op)}};
+        }
+        for (auto const& arg : args) response.replies.push_back(session_event(op.c_str(), arg));
+    } catch (const std::exception& e) {
+        return {{session_error(e.what())}};
+    }
+    if (debug_) REPEATER_LOG(debug, "[Core] Session {}: {}", session_id, message);
+    return response;
+}
+
+ControlServer::Response RepeaterCore::handle_control(const ControlServer::Request& req) {
+    std::string_view const target(req.target().data(), req.target().size());
+    if (debug_) REPEATER_LOG(debug, "[Control] {} {}", req.method_string(), target);
+
+    // 请求体中的 "feed" 指定上游分组，返回feeds_.size()表示没有这个组
+    auto const feed_named = [this](const nlohmann::json& body) {
+        auto const name = body.at("feed").get<std::string>();
+        auto const it = std::find_if(feeds_.begin(), feeds_.end(), [&](const Feed& f) { return f.name == name; });
+        return static_cast<std::size_t>(it - feeds_.begin());
+    };
+
+    try {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        if (target == "/status" && req.method() == http::verb::get) {
+            return json_response(http::status::ok, status());
+        }
+        if (target == "/connections" && req.method() == http::verb::post) {
+            auto const body = nlohmann::json::parse(req.body());
+            // 没有指定 "feed" 时加入接收其余订阅的组
+            auto const feed = body.contains("feed") ? feed_named(body) : feed_for(nlohmann::json::object());
+            if (feed == feeds_.size()) return error_response(http::status::not_found, "no such feed");
+            auto const id = add_connection(body.at("url").get<std::string>(), feed);
+            if (id < 0) return error_response(http::status::conflict, "too many sources");
+            return json_response(http::status::created, {{"id", id}});
+        }
+        if (target.rfind("/connections/", 0) == 0 && req.method() == http::verb::delete_) {
+            auto const id = std::stoi(std::string(target.substr(13)));
+            if (!remove_connection(id)) return error_response(http::status::not_found, "no such connection");
+            return json_response(http::status::ok, {{"removed", id}});
+        }
+        if (target == "/subscriptions" && req.method() == http::verb::post) {
+            auto const body = nlohmann::json::parse(req.body());
+            auto const feed = body.contains("feed") ? feed_named(body) : feeds_.size();
+            if (body.contains("feed") && feed == feeds_.size()) {
+                return error_response(http::status::not_found, "no such feed");
+            }
+            auto unpinned = nlohmann::json::array();
+            for (auto const& f : feeds_) {
+                for (auto const& arg : f.subscriptions->unpin(body.value("unsubscribe", nlohmann::json::array()))) {
+                    unpinned.push_back(arg);
+                }
+            }
+            // 没有指定 "feed" 时，每个arg与下游会话的订阅一样按channel选择上游分组
+            auto pinned = nlohmann::json::array();
+            for (auto const& arg : body.value("subscribe", nlohmann::json::array())) {
+                for (auto const& changed : feeds_[feed < feeds_.size() ? feed : feed_for(arg)].subscriptions->pin(nlohmann::json::array({arg}))) {
+                    pinned.push_back(changed);
+                }
+            }
+            return json_response(http::status::ok, {{"pinned", pinned}, {"unpinned", unpinned}});
+        }
+        if (target == "/reload" && req.method() == http::verb::post) {
+            return json_response(http::status::ok, reload());
+        }
+        if (target == "/trace/dump" && req.method() == http::verb::post) {
+            auto const [path, records] = trace::dump("manual");
+            return json_response(http::status::ok, {{"path", path}, {"records", records}});
+        }
+        return error_response(http::status::not_found, "unknown route");
+    } catch (const std::exception& e) {
+        return error_response(http::status::bad_request, e.what());
+    }
 }
 
-} // namespace repeater
\ No newline at end of file
+} // namespace repeater
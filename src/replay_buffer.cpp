@@ -0,0 +1,48 @@
+#include "repeater/replay_buffer.hpp"
+
+namespace repeater {
+
+void ReplayBuffer::append(std::size_t stream_index, std::string_view channel, std::string_view inst_id,
+                          std::int64_t key, MessagePtr const& message) {
+    if (depth_ == 0) return;
+    if (stream_index >= rings_.size()) {
+        rings_.resize(stream_index + 1);
+    }
+    auto& ring = rings_[stream_index];
+    if (!ring) {
+        ring = std::make_unique<Ring>();
+        ring->entries.reserve(depth_);
+        by_name_.emplace(std::make_pair(std::string(channel), std::string(inst_id)), ring.get());
+    }
+
+    auto const order = next_order_++;
+    if (ring->entries.size() < depth_) {
+        ring->entries.push_back(Entry{key, order, message});
+        return;
+    }
+    ring->entries[ring->next] = Entry{key, order, message};
+    ring->next = (ring->next + 1) % depth_;
+    ring->wrapped = true;
+}
+
+ReplayBuffer::Result ReplayBuffer::collect(std::string_view channel, std::string_view inst_id, std::int64_t after,
+                                           std::vector<Replayed>& out) const {
+    Result result;
+    auto const it = by_name_.find(std::make_pair(std::string(channel), std::string(inst_id)));
+    if (it == by_name_.end()) return result;
+
+    auto const& ring = *it->second;
+    auto const size = ring.entries.size();
+    // 从未丢弃过消息，或者最旧的一条不晚于after，说明after之后的消息都还在
+    result.complete = !ring.wrapped || ring.entries[ring.next].key <= after;
+    for (std::size_t i = 0; i < size; ++i) {
+        auto const& entry = ring.entries[(ring.next + i) % size];
+        if (entry.key > after) {
+            out.push_back(Replayed{entry.order, entry.message});
+            ++result.replayed;
+        }
+    }
+    return result;
+}
+
+} // namespace repeater
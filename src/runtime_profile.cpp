@@ -0,0 +1,204 @@
+#include "repeater/runtime_profile.hpp"
+#include "repeater/log.hpp"
+#include "repeater/trace.hpp"
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <alloca.h>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+
+namespace repeater {
+
+namespace {
+
+constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+constexpr std::size_t page_size = 4096;
+
+// 写每个页面一次，使缺页发生在启动阶段
+void touch(char* data, std::size_t bytes) {
+    for (std::size_t offset = 0; offset < bytes; offset += page_size) {
+        static_cast<volatile char*>(data)[offset] = 0;
+    }
+}
+
+int numa_node_of(int cpu) {
+    std::error_code ec;
+    auto const dir = std::filesystem::path("/sys/devices/system/cpu") / ("cpu" + std::to_string(cpu));
+    for (auto const& entry : std::filesystem::directory_iterator(dir, ec)) {
+        auto const name = entry.path().filename().string();
+        if (name.rfind("node", 0) == 0) return std::stoi(name.substr(4));
+    }
+    return -1;
+}
+
+// 栈上分配并写入，使之后的深层调用不再在热路径上触发栈的缺页
+__attribute__((noinline)) void prefault_stack(std::size_t bytes) {
+    auto* stack = static_cast<char*>(alloca(bytes));
+    touch(stack, bytes);
+    asm volatile("" : : "r"(stack) : "memory");
+}
+
+struct HotArena {
+    std::mutex mutex;
+    HotRegion region;
+    std::size_t used = 0;
+};
+
+HotArena& arena() {
+    static HotArena instance;
+    return instance;
+}
+
+thread_local bool bypass_arena = false;
+
+} // namespace
+
+RuntimeProfile RuntimeProfile::from_json(const nlohmann::json& j) {
+    RuntimeProfile p;
+    if (!j.is_object()) return p;
+    p.lock_memory = j.value("lock_memory", p.lock_memory);
+    p.huge_pages = j.value("huge_pages", p.huge_pages);
+    p.prefault = j.value("prefault", p.prefault);
+    p.io_cpus = j.value("io_cpus", p.io_cpus);
+    p.numa_local = j.value("numa_local", p.numa_local);
+    p.stack_prefault_kb = j.value("stack_prefault_kb", p.stack_prefault_kb);
+    p.dedup_arena_mb = j.value("dedup_arena_mb", p.dedup_arena_mb);
+    p.warmup_messages = j.value("warmup_messages", p.warmup_messages);
+    return p;
+}
+
+HotRegion::HotRegion(std::size_t bytes, const RuntimeProfile& profile, const char* what) {
+    if (bytes == 0) return;
+    void* data = MAP_FAILED;
+    std::size_t size = (bytes + page_size - 1) / page_size * page_size;
+    if (profile.huge_pages) {
+        // 显式大页需要预先在vm.nr_hugepages中保留；失败时退化为透明大页
+        auto const huge_size = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+        data = ::mmap(nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED) {
+            size = huge_size;
+            REPEATER_LOG(info, "[Runtime] {}: {} explicit huge pages", what, size / huge_page_size);
+        }
+    }
+    if (data == MAP_FAILED) {
+        data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) throw std::bad_alloc();
+        if (profile.huge_pages) {
+            if (::madvise(data, size, MADV_HUGEPAGE) != 0) {
+                REPEATER_LOG(warn, "[Runtime] {}: madvise(MADV_HUGEPAGE) failed: {}", what, std::strerror(errno));
+            } else {
+                REPEATER_LOG(info, "[Runtime] {}: no explicit huge pages reserved, using transparent huge pages", what);
+            }
+        }
+    }
+    data_ = static_cast<char*>(data);
+    size_ = size;
+    if (profile.prefault) touch(data_, size_);
+}
+
+HotRegion::~HotRegion() {
+    if (data_) ::munmap(data_, size_);
+}
+
+HotRegion::HotRegion(HotRegion&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+HotRegion& HotRegion::operator=(HotRegion&& other) noexcept {
+    if (this != &other) {
+        if (data_) ::munmap(data_, size_);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+void apply_process_profile(const RuntimeProfile& profile) {
+    if (profile.numa_local && !profile.io_cpus.empty()) {
+        auto const node = numa_node_of(profile.io_cpus.front());
+        if (node < 0 || node >= static_cast<int>(sizeof(unsigned long) * 8)) {
+            REPEATER_LOG(warn, "[Runtime] Could not find the NUMA node of CPU {}", profile.io_cpus.front());
+        } else {
+            // 之后由本线程及其创建的线程分配的内存优先放在I/O核所在的节点上
+            unsigned long mask = 1UL << node;
+            if (::syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) != 0) {
+                REPEATER_LOG(warn, "[Runtime] set_mempolicy failed: {}", std::strerror(errno));
+            } else {
+                REPEATER_LOG(info, "[Runtime] Memory preferred on NUMA node {}", node);
+            }
+        }
+    }
+    if (profile.lock_memory) {
+        if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            REPEATER_LOG(warn, "[Runtime] mlockall failed: {} (check RLIMIT_MEMLOCK / CAP_IPC_LOCK)",
+                         std::strerror(errno));
+        } else {
+            REPEATER_LOG(info, "[Runtime] Process memory locked");
+        }
+    }
+}
+
+void prepare_io_thread(const RuntimeProfile& profile, std::size_t index) {
+    if (!profile.io_cpus.empty()) {
+        auto const cpu = profile.io_cpus[index % profile.io_cpus.size()];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (auto const rc = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set); rc != 0) {
+            REPEATER_LOG(warn, "[Runtime] Pinning I/O thread {} to CPU {} failed: {}", index, cpu, std::strerror(rc));
+        }
+    }
+    if (profile.prefault) prefault_stack(profile.stack_prefault_kb * 1024);
+    trace::attach_thread();
+}
+
+void configure_hot_arena(const RuntimeProfile& profile) {
+    auto& hot = arena();
+    std::lock_guard<std::mutex> lock(hot.mutex);
+    hot.region = HotRegion(profile.dedup_arena_mb * 1024 * 1024, profile, "Dedup tables");
+    hot.used = 0;
+}
+
+void* hot_allocate(std::size_t bytes) {
+    if (bypass_arena) return ::operator new(bytes);
+    auto& hot = arena();
+    {
+        std::lock_guard<std::mutex> lock(hot.mutex);
+        auto const aligned = (bytes + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+        if (hot.region.data() && hot.used + aligned <= hot.region.size()) {
+            void* pointer = hot.region.data() + hot.used;
+            hot.used += aligned;
+            return pointer;
+        }
+    }
+    return ::operator new(bytes);
+}
+
+void hot_deallocate(void* pointer) noexcept {
+    auto& hot = arena();
+    auto* const bytes = static_cast<char*>(pointer);
+    {
+        std::lock_guard<std::mutex> lock(hot.mutex);
+        if (hot.region.data() && bytes >= hot.region.data() && bytes < hot.region.data() + hot.region.size()) return;
+    }
+    ::operator delete(pointer);
+}
+
+HotArenaBypass::HotArenaBypass() : previous_(bypass_arena) {
+    bypass_arena = true;
+}
+
+HotArenaBypass::~HotArenaBypass() {
+    bypass_arena = previous_;
+}
+
+} // namespace repeater
@@ -0,0 +1,119 @@
+#include "repeater/socket_profile.hpp"
+#include "repeater/log.hpp"
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
+namespace repeater {
+
+namespace {
+
+bool set_int_option(int fd, int level, int name, int value, const char* option, const char* who) {
+    if (::setsockopt(fd, level, name, &value, sizeof(value)) != 0) {
+        REPEATER_LOG(warn, "[{}] setsockopt({}={}) failed: {}", who, option, value, std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+int get_int_option(int fd, int level, int name) {
+    int value = -1;
+    socklen_t len = sizeof(value);
+    if (::getsockopt(fd, level, name, &value, &len) != 0) {
+        return -1;
+    }
+    return value;
+}
+
+} // namespace
+
+SocketProfile SocketProfile::from_json(const nlohmann::json& j) {
+    SocketProfile p;
+    if (!j.is_object()) return p;
+    p.tcp_nodelay = j.value("tcp_nodelay", p.tcp_nodelay);
+    p.tcp_quickack = j.value("tcp_quickack", p.tcp_quickack);
+    p.rcvbuf = j.value("rcvbuf", p.rcvbuf);
+    p.sndbuf = j.value("sndbuf", p.sndbuf);
+    p.busy_poll_us = j.value("busy_poll_us", p.busy_poll_us);
+    p.ip_tos = j.value("ip_tos", p.ip_tos);
+    p.priority = j.value("priority", p.priority);
+    p.read_buffer_size = j.value("read_buffer_size", p.read_buffer_size);
+    return p;
+}
+
+std::string SocketReport::to_string() const {
+    std::ostringstream os;
+    os << "TCP_NODELAY=" << tcp_nodelay
+       << " SO_RCVBUF=" << rcvbuf
+       << " SO_SNDBUF=" << sndbuf
+       << " SO_BUSY_POLL=" << busy_poll_us
+       << " IP_TOS=" << ip_tos
+       << " SO_PRIORITY=" << priority;
+    return os.str();
+}
+
+int apply_socket_profile(int fd, const SocketProfile& profile, const char* who) {
+    int failures = 0;
+    if (profile.tcp_nodelay) {
+        failures += !set_int_option(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY", who);
+    }
+    if (profile.tcp_quickack) {
+        failures += !set_int_option(fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK", who);
+    }
+    if (profile.rcvbuf > 0) {
+        failures += !set_int_option(fd, SOL_SOCKET, SO_RCVBUF, profile.rcvbuf, "SO_RCVBUF", who);
+    }
+    if (profile.sndbuf > 0) {
+        failures += !set_int_option(fd, SOL_SOCKET, SO_SNDBUF, profile.sndbuf, "SO_SNDBUF", who);
+    }
+    if (profile.busy_poll_us > 0) {
+        failures += !set_int_option(fd, SOL_SOCKET, SO_BUSY_POLL, profile.busy_poll_us, "SO_BUSY_POLL", who);
+    }
+    if (profile.ip_tos >= 0) {
+        failures += !set_int_option(fd, IPPROTO_IP, IP_TOS, profile.ip_tos, "IP_TOS", who);
+    }
+    if (profile.priority >= 0) {
+        failures += !set_int_option(fd, SOL_SOCKET, SO_PRIORITY, profile.priority, "SO_PRIORITY", who);
+    }
+    return failures;
+}
+
+void rearm_quickack(int fd) {
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+}
+
+SocketReport query_socket(int fd) {
+    SocketReport r;
+    r.tcp_nodelay = get_int_option(fd, IPPROTO_TCP, TCP_NODELAY);
+    r.rcvbuf = get_int_option(fd, SOL_SOCKET, SO_RCVBUF);
+    r.sndbuf = get_int_option(fd, SOL_SOCKET, SO_SNDBUF);
+    r.busy_poll_us = get_int_option(fd, SOL_SOCKET, SO_BUSY_POLL);
+    r.ip_tos = get_int_option(fd, IPPROTO_IP, IP_TOS);
+    r.priority = get_int_option(fd, SOL_SOCKET, SO_PRIORITY);
+    return r;
+}
+
+SocketReport probe_socket_profile(const SocketProfile& profile) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        REPEATER_LOG(warn, "[SocketProfile] Could not create probe socket: {}", std::strerror(errno));
+        return {};
+    }
+    apply_socket_profile(fd, profile, "SocketProfile");
+    SocketReport r = query_socket(fd);
+    ::close(fd);
+    return r;
+}
+
+} // namespace repeater
@@ -0,0 +1,212 @@
+#include "repeater/subscription_manager.hpp"
+#include "repeater/log.hpp"
+#include <boost/asio/post.hpp>
+#include <stdexcept>
+
+namespace repeater {
+
+SubscriptionManager::SubscriptionManager(net::io_context& ioc, std::chrono::milliseconds batch_window,
+                                         Publish publish, bool debug)
+    : strand_(net::make_strand(ioc)),
+      timer_(strand_),
+      batch_window_(batch_window),
+      publish_(std::move(publish)),
+      debug_(debug) {}
+
+std::string SubscriptionManager::key_of(const nlohmann::json& arg, nlohmann::json* normalized) {
+    if (!arg.is_object() || !arg.contains("channel") || !arg["channel"].is_string()) {
+        throw std::invalid_argument("subscription arg must be an object with a \"channel\" field: " + arg.dump());
+    }
+    // 去掉配置文件中以'#'开头的注释字段；nlohmann::json的对象按key排序，dump结果可直接作为key
+    auto clean = nlohmann::json::object();
+    for (auto const& [name, value] : arg.items()) {
+        if (!name.empty() && name.front() != '#') clean[name] = value;
+    }
+    auto key = clean.dump();
+    if (normalized) *normalized = std::move(clean);
+    return key;
+}
+
+std::vector<std::string> SubscriptionManager::make_ops(const char* op, const nlohmann::json& args) {
+    std::vector<std::string> ops;
+    auto batch = nlohmann::json::array();
+    std::size_t bytes = 0;
+    for (auto const& arg : args) {
+        auto const arg_bytes = arg.dump().size() + 1;
+        if (!batch.empty() && bytes + arg_bytes > max_op_bytes) {
+            ops.push_back(nlohmann::json{{"op", op}, {"args", batch}}.dump());
+            batch = nlohmann::json::array();
+            bytes = 0;
+        }
+        batch.push_back(arg);
+        bytes += arg_bytes;
+    }
+    if (!batch.empty()) ops.push_back(nlohmann::json{{"op", op}, {"args", batch}}.dump());
+    return ops;
+}
+
+void SubscriptionManager::ref(const std::string& key, const nlohmann::json& arg) {
+    // 调用方持有mutex_
+    auto [it, inserted] = entries_.try_emplace(key);
+    if (inserted) it->second.arg = arg;
+    ++it->second.refs;
+}
+
+void SubscriptionManager::unref(const std::string& key) {
+    // 调用方持有mutex_
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return;
+    if (--it->second.refs == 0 && !it->second.pinned) entries_.erase(it);
+}
+
+nlohmann::json SubscriptionManager::pin(const nlohmann::json& args) {
+    auto changed = nlohmann::json::array();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto const& arg : args) {
+        nlohmann::json clean;
+        auto const key = key_of(arg, &clean);
+        auto [it, inserted] = entries_.try_emplace(key);
+        if (inserted) it->second.arg = clean;
+        if (it->second.pinned) continue;
+        it->second.pinned = true;
+        changed.push_back(clean);
+    }
+    if (!changed.empty()) schedule_flush();
+    return changed;
+}
+
+nlohmann::json SubscriptionManager::unpin(const nlohmann::json& args) {
+    auto changed = nlohmann::json::array();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto const& arg : args) {
+        auto const key = key_of(arg);
+        auto it = entries_.find(key);
+        if (it == entries_.end() || !it->second.pinned) continue;
+        changed.push_back(it->second.arg);
+        it->second.pinned = false;
+        if (it->second.refs == 0) entries_.erase(it);
+    }
+    if (!changed.empty()) schedule_flush();
+    return changed;
+}
+
+nlohmann::json SubscriptionManager::pinned() const {
+    auto args = nlohmann::json::array();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto const& [key, entry] : entries_) {
+        if (entry.pinned) args.push_back(entry.arg);
+    }
+    return args;
+}
+
+void SubscriptionManager::acquire(std::uint64_t owner, const nlohmann::json& args) {
+    // 先校验全部arg，避免请求只被部分应用
+    std::vector<std::pair<std::string, nlohmann::json>> parsed;
+    for (auto const& arg : args) {
+        nlohmann::json clean;
+        auto key = key_of(arg, &clean);
+        parsed.emplace_back(std::move(key), std::move(clean));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& held = owners_[owner];
+    for (auto const& [key, clean] : parsed) {
+        if (held.insert(key).second) ref(key, clean);
+    }
+    schedule_flush();
+}
+
+void SubscriptionManager::release(std::uint64_t owner, const nlohmann::json& args) {
+    std::vector<std::string> keys;
+    for (auto const& arg : args) keys.push_back(key_of(arg));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = owners_.find(owner);
+    if (it == owners_.end()) return;
+    for (auto const& key : keys) {
+        if (it->second.erase(key)) unref(key);
+    }
+    if (it->second.empty()) owners_.erase(it);
+    schedule_flush();
+}
+
+void SubscriptionManager::release_all(std::uint64_t owner) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = owners_.find(owner);
+    if (it == owners_.end()) return;
+    for (auto const& key : it->second) unref(key);
+    owners_.erase(it);
+    schedule_flush();
+}
+
+std::vector<std::string> SubscriptionManager::replay_messages() const {
+    auto args = nlohmann::json::array();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto const& [key, arg] : upstream_) args.push_back(arg);
+    return make_ops("subscribe", args);
+}
+
+nlohmann::json SubscriptionManager::status() const {
+    auto result = nlohmann::json::array();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto const& [key, entry] : entries_) {
+        result.push_back({{"arg", entry.arg}, {"sessions", entry.refs}, {"pinned", entry.pinned},
+                          {"upstream", upstream_.count(key) > 0}});
+    }
+    // 已不再需要、但还在等待批量退订的arg
+    for (auto const& [key, arg] : upstream_) {
+        if (!entries_.count(key)) {
+            result.push_back({{"arg", arg}, {"sessions", 0}, {"pinned", false}, {"upstream", true}});
+        }
+    }
+    return result;
+}
+
+void SubscriptionManager::schedule_flush() {
+    // 调用方持有mutex_
+    if (flush_scheduled_) return;
+    flush_scheduled_ = true;
+    net::post(strand_, [this] {
+        timer_.expires_after(batch_window_);
+        timer_.async_wait([this](boost::system::error_code ec) {
+            if (ec) return;
+            flush();
+        });
+    });
+}
+
+void SubscriptionManager::flush() {
+    SubscriptionUpdate update;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flush_scheduled_ = false;
+        for (auto it = upstream_.begin(); it != upstream_.end();) {
+            if (entries_.count(it->first)) {
+                ++it;
+            } else {
+                update.unsubscribed.push_back(it->second);
+                it = upstream_.erase(it);
+            }
+        }
+        for (auto const& [key, entry] : entries_) {
+            if (upstream_.emplace(key, entry.arg).second) update.subscribed.push_back(entry.arg);
+        }
+        if (update.subscribed.empty() && update.unsubscribed.empty()) return;
+
+        auto all = nlohmann::json::array();
+        for (auto const& [key, arg] : upstream_) all.push_back(arg);
+        update.replay = make_ops("subscribe", all);
+    }
+
+    update.ops = make_ops("unsubscribe", update.unsubscribed);
+    auto subscribe_ops = make_ops("subscribe", update.subscribed);
+    update.ops.insert(update.ops.end(), subscribe_ops.begin(), subscribe_ops.end());
+
+    if (debug_) {
+        REPEATER_LOG(debug, "[Subscriptions] +{} -{} upstream args in {} op message(s)", update.subscribed.size(),
+                     update.unsubscribed.size(), update.ops.size());
+    }
+    publish_(update);
+}
+
+} // namespace repeater
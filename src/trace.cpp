@@ -0,0 +1,193 @@
+#include "repeater/trace.hpp"
+#include "repeater/log.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace repeater::trace {
+
+namespace detail {
+
+bool enabled = false;
+std::uint64_t threshold_tsc = 0;
+
+} // namespace detail
+
+namespace {
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<detail::Ring>> rings;
+    std::size_t ring_size = 65536;
+    std::string dump_dir = ".";
+    double tsc_per_ns = 1.0;
+    std::uint64_t cooldown_tsc = 0;
+    std::atomic<std::uint64_t> last_trip{0};
+    std::atomic<std::uint64_t> dump_count{0};
+
+    // 自动导出线程
+    std::thread dumper;
+    std::mutex dumper_mutex;
+    std::condition_variable dumper_cv;
+    bool dump_pending = false;
+    bool stopping = false;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+/**
+ * 用steady_clock标定TSC频率。非x86平台上now()本身就是纳秒。
+ */
+double calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+    auto const wall_start = std::chrono::steady_clock::now();
+    auto const tsc_start = now();
+    while (std::chrono::steady_clock::now() - wall_start < std::chrono::milliseconds(20)) {
+    }
+    auto const tsc_end = now();
+    auto const wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - wall_start).count();
+    return static_cast<double>(tsc_end - tsc_start) / static_cast<double>(wall_ns);
+#else
+    return 1.0;
+#endif
+}
+
+std::size_t round_up_pow2(std::size_t n) {
+    std::size_t size = 1;
+    while (size < n) size <<= 1;
+    return size;
+}
+
+} // namespace
+
+Options Options::from_json(const nlohmann::json& config) {
+    Options options;
+    if (!config.is_object()) return options;
+    options.enabled = config.value("enabled", options.enabled);
+    options.ring_size = config.value("ring_size", options.ring_size);
+    options.threshold_us = config.value("threshold_us", options.threshold_us);
+    options.dump_dir = config.value("dump_dir", options.dump_dir);
+    options.cooldown_sec = config.value("cooldown_sec", options.cooldown_sec);
+    return options;
+}
+
+void configure(const Options& options) {
+    auto& reg = registry();
+    reg.ring_size = round_up_pow2(std::max<std::size_t>(options.ring_size, 1024));
+    reg.dump_dir = options.dump_dir;
+    detail::enabled = options.enabled;
+    // 校准要忙等约20ms，关闭时不会产生记录，不需要换算
+    if (!options.enabled) return;
+    reg.tsc_per_ns = calibrate();
+    reg.cooldown_tsc = static_cast<std::uint64_t>(options.cooldown_sec * 1e9 * reg.tsc_per_ns);
+    if (options.threshold_us == 0) return;
+
+    detail::threshold_tsc = static_cast<std::uint64_t>(options.threshold_us * 1e3 * reg.tsc_per_ns);
+    reg.dumper = std::thread([&reg] {
+        std::unique_lock<std::mutex> lock(reg.dumper_mutex);
+        for (;;) {
+            reg.dumper_cv.wait(lock, [&reg] { return reg.dump_pending || reg.stopping; });
+            if (reg.stopping) return;
+            reg.dump_pending = false;
+            lock.unlock();
+            try {
+                auto const [path, count] = dump("threshold");
+                REPEATER_LOG(info, "[Trace] Latency threshold exceeded, dumped {} records to {}", count, path);
+            } catch (const std::exception& e) {
+                REPEATER_LOG(error, "[Trace] Dump failed: {}", e.what());
+            }
+            lock.lock();
+        }
+    });
+}
+
+void shutdown() {
+    auto& reg = registry();
+    detail::threshold_tsc = 0;
+    if (!reg.dumper.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(reg.dumper_mutex);
+        reg.stopping = true;
+    }
+    reg.dumper_cv.notify_one();
+    reg.dumper.join();
+}
+
+detail::Ring* detail::register_ring() {
+    auto& reg = registry();
+    auto ring = std::make_unique<Ring>();
+    ring->records = std::make_unique<Record[]>(reg.ring_size);
+    ring->mask = reg.ring_size - 1;
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    ring->id_prefix = static_cast<std::uint64_t>(reg.rings.size() + 1) << 48;
+    reg.rings.push_back(std::move(ring));
+    return reg.rings.back().get();
+}
+
+void detail::trip() {
+    auto& reg = registry();
+    auto const tsc = now();
+    auto last = reg.last_trip.load(std::memory_order_relaxed);
+    if (last != 0 && tsc - last < reg.cooldown_tsc) return;
+    if (!reg.last_trip.compare_exchange_strong(last, tsc, std::memory_order_relaxed)) return;
+    {
+        std::lock_guard<std::mutex> lock(reg.dumper_mutex);
+        reg.dump_pending = true;
+    }
+    reg.dumper_cv.notify_one();
+}
+
+std::pair<std::string, std::size_t> dump(std::string_view reason) {
+    auto& reg = registry();
+    std::vector<Record> records;
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (auto const& ring : reg.rings) {
+            // 写线程不停，先拷贝再检查head：拷贝期间可能被覆盖的最旧记录丢弃
+            auto const size = ring->mask + 1;
+            auto const head = ring->head.load(std::memory_order_acquire);
+            auto const first = head > size ? head - size : 0;
+            auto const offset = records.size();
+            for (auto i = first; i < head; ++i) {
+                records.push_back(ring->records[i & ring->mask]);
+            }
+            auto const head_after = ring->head.load(std::memory_order_acquire);
+            auto const valid = head_after >= size ? head_after - size + 1 : 0;
+            if (valid > first) {
+                auto const stale = static_cast<std::ptrdiff_t>(std::min(valid, head) - first);
+                records.erase(records.begin() + static_cast<std::ptrdiff_t>(offset),
+                              records.begin() + static_cast<std::ptrdiff_t>(offset) + stale);
+            }
+        }
+    }
+
+    auto const stamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    auto const path = reg.dump_dir + "/repeater-trace-" + std::to_string(stamp) + "-" +
+                      std::to_string(reg.dump_count.fetch_add(1)) + "-" + std::string(reason) + ".bin";
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("cannot open " + path);
+    }
+    DumpHeader header{};
+    std::copy(std::begin(dump_magic), std::end(dump_magic), header.magic);
+    header.tsc_per_ns = reg.tsc_per_ns;
+    header.record_count = records.size();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(records.data()),
+              static_cast<std::streamsize>(records.size() * sizeof(Record)));
+    if (!out) {
+        throw std::runtime_error("failed writing " + path);
+    }
+    return {path, records.size()};
+}
+
+} // namespace repeater::trace
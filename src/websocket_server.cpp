@@ -1,5 +1,17 @@
 #include "repeater/websocket_server.hpp"
-#include <iostream>
+#include "repeater/handler_memory.hpp"
+#include "repeater/log.hpp"
+#include "repeater/permessage_deflate.hpp"
+#include "repeater/trace.hpp"
+#include "repeater/ws_frame.hpp"
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/http.hpp>
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <optional>
 #include <vector>
 
 namespace beast = boost::beast;
@@ -11,118 +23,498 @@ using tcp = net::ip::tcp;
 
 namespace repeater {
 
+namespace {
+
+std::string percent_decode(std::string_view value) {
+    std::string out;
+    out.reserve(value.size());
+    for (std::size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '%' && i + 2 < value.size()) {
+            std::string const hex(value.substr(i + 1, 2));
+            char* end = nullptr;
+            auto const byte = std::strtol(hex.c_str(), &end, 16);
+            if (end == hex.c_str() + 2) {
+                out.push_back(static_cast<char>(byte));
+                i += 2;
+                continue;
+            }
+        }
+        out.push_back(value[i]);
+    }
+    return out;
+}
+
+} // namespace
+
+/**
+ * 握手之后由会话自己完成分帧的下游连接。
+ *
+ * HTTP升级仍交给Beast处理；之后写路径直接发送MessageBuffer中预先分好帧的字节，
+ * 一次gather写带出写队列中最多max_write_batch条消息，突发期间每批只需一次sendmsg，
+ * 而不是每条消息一次(Beast的websocket::stream每次async_write只能写一帧)。
+ */
 class WebSocketSession : public std::enable_shared_from_this<WebSocketSession> {
-    websocket::stream<beast::tcp_stream> ws_;
-    beast::flat_buffer buffer_;
-    std::vector<std::shared_ptr<const std::string>> queue_;
+    // async_write只保存这个视图，不拷贝iovecs_，写路径上不产生堆分配
+    struct BufferView {
+        using value_type = net::const_buffer;
+        using const_iterator = const net::const_buffer*;
+        const_iterator first;
+        const_iterator last;
+        const_iterator begin() const { return first; }
+        const_iterator end() const { return last; }
+    };
+
+    static constexpr std::size_t max_write_batch = 64;            // 不超过Asio单次系统调用的iovec数
+    static constexpr std::size_t max_client_message = 64 * 1024;  // 下游请求的长度上限
+    static constexpr std::size_t read_chunk = 4096;
+    static constexpr std::size_t initial_queue_capacity = 256;
+    static constexpr auto handshake_timeout = std::chrono::seconds(30);
+    static constexpr auto idle_timeout = std::chrono::seconds(300);
+
+    strand_tcp_stream stream_;
+    // 空闲检测只用一个定时器：读路径只记录时间，不像stream_的超时那样为每次读写都挂一个定时器操作
+    net::steady_timer idle_timer_;
+    std::chrono::steady_clock::time_point last_read_;
+    beast::flat_buffer buffer_;  // 升级请求以及之后客户端帧的读缓冲区
+    http::request<http::string_body> upgrade_request_;
+    std::optional<websocket::stream<strand_tcp_stream&>> handshake_;
+    std::uint64_t id_;
+    std::size_t tier_ = 0;
+    // 协商了permessage-deflate时握手响应中的Sec-WebSocket-Extensions，为空表示不压缩
+    std::string deflate_response_;
+    // 读完升级请求后选择层级，返回该层级专用的io_context(没有则为nullptr)
+    std::function<net::io_context*(std::shared_ptr<WebSocketSession>, const http::request<http::string_body>&)> on_upgrade_;
+    std::function<void(std::shared_ptr<WebSocketSession>, std::string_view)> on_open_;
     std::function<void(std::shared_ptr<WebSocketSession>)> on_leave_;
+    std::function<void(std::shared_ptr<WebSocketSession>, std::string_view)> on_message_;
+    MessagePool& pool_;
+    const SocketProfile& socket_profile_;
     bool debug_;
 
+    // 分片的客户端消息
+    std::string fragments_;
+    bool fragmented_ = false;
+    bool compressed_ = false;  // 当前客户端消息的第一帧带RSV1
+    std::string inflated_;
+
+    // 写队列，仅在会话的strand上访问；write_index_之前的元素已写完
+    std::vector<MessagePtr> queue_;
+    std::size_t write_index_ = 0;
+    std::array<net::const_buffer, max_write_batch> iovecs_;
+    std::size_t iovec_count_ = 0;
+    bool writing_ = false;
+    bool closing_ = false;  // close帧已入队，之后的消息全部丢弃
+
+    // broadcast线程投递的收件箱。同一时刻最多只有一个on_drain在排队，
+    // 突发期间多条消息合并为一次post；两个vector交换时保留各自的容量，稳态下不再分配
+    std::mutex inbox_mutex_;
+    std::vector<MessagePtr> inbox_;
+    bool drain_scheduled_ = false;
+
+    // 按流过滤投递。filtered_在会话第一次订阅后置位，之前不加锁直接投递；
+    // decisions_按流序号缓存匹配结果(0未知，1投递，2跳过)，订阅变化时清空
+    std::atomic<bool> filtered_{false};
+    std::mutex filter_mutex_;
+    std::vector<StreamSelector> selectors_;
+    std::vector<std::uint8_t> decisions_;
+
+    // 读、写(含投递)路径各自的异步操作内存
+    HandlerMemory read_memory_;
+    HandlerMemory write_memory_;
+
 public:
-    WebSocketSession(tcp::socket&& socket, std::function<void(std::shared_ptr<WebSocketSession>)> on_leave, bool debug)
-        : ws_(std::move(socket)), on_leave_(std::move(on_leave)), debug_(debug) {}
+    WebSocketSession(strand_socket&& socket, std::uint64_t id,
+                     std::function<net::io_context*(std::shared_ptr<WebSocketSession>, const http::request<http::string_body>&)> on_upgrade,
+                     std::function<void(std::shared_ptr<WebSocketSession>, std::string_view)> on_open,
+                     std::function<void(std::shared_ptr<WebSocketSession>)> on_leave,
+                     std::function<void(std::shared_ptr<WebSocketSession>, std::string_view)> on_message,
+                     MessagePool& pool, const SocketProfile& socket_profile, bool debug)
+        : stream_(std::move(socket)), idle_timer_(stream_.get_executor()), id_(id), on_upgrade_(std::move(on_upgrade)), on_open_(std::move(on_open)), on_leave_(std::move(on_leave)), on_message_(std::move(on_message)),
+          pool_(pool), socket_profile_(socket_profile), debug_(debug) {
+        apply_socket_profile(stream_.socket(), socket_profile_, "Server Session");
+        queue_.reserve(initial_queue_capacity);
+        inbox_.reserve(initial_queue_capacity);
+    }
 
     ~WebSocketSession() {
-        if (debug_) std::cout << "[Server Session] Destroyed." << std::endl;
+        if (debug_) REPEATER_LOG(debug, "[Server Session] Destroyed.");
     }
 
+    std::uint64_t id() const { return id_; }
+    std::size_t tier() const { return tier_; }
+    void set_tier(std::size_t tier) { tier_ = tier; }
+    bool deflate() const { return !deflate_response_.empty(); }
+    void enable_deflate(std::string response) { deflate_response_ = std::move(response); }
+
     void run() {
-        net::dispatch(ws_.get_executor(),
+        net::dispatch(stream_.get_executor(),
             beast::bind_front_handler(&WebSocketSession::on_run, shared_from_this()));
     }
 
     void on_run() {
-        ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
-        ws_.set_option(websocket::stream_base::decorator(
-            [](websocket::response_type& res) {
+        stream_.expires_after(handshake_timeout);
+        http::async_read(stream_, buffer_, upgrade_request_,
+            beast::bind_front_handler(&WebSocketSession::on_upgrade, shared_from_this()));
+    }
+
+    void on_upgrade(beast::error_code ec, std::size_t) {
+        if (ec) {
+            if (debug_) REPEATER_LOG(warn, "[Server Session] Upgrade read error: {}", ec.message());
+            on_leave_(shared_from_this());
+            return;
+        }
+        if (!websocket::is_upgrade(upgrade_request_)) {
+            if (debug_) REPEATER_LOG(warn, "[Server Session] Not a WebSocket upgrade request.");
+            on_leave_(shared_from_this());
+            return;
+        }
+        if (auto* const context = on_upgrade_(shared_from_this(), upgrade_request_)) {
+            hand_off(*context);
+            return;
+        }
+        accept_upgrade();
+    }
+
+    /**
+     * @brief 把连接移交给层级专用的io_context：在那里用同一个socket创建新会话并继续握手。
+     * 此时会话上没有未完成的异步操作，也还没有加入广播。
+     */
+    void hand_off(net::io_context& context) {
+        beast::error_code ec;
+        auto const protocol = stream_.socket().local_endpoint(ec).protocol();
+        auto const native = ec ? -1 : stream_.socket().release(ec);
+        strand_socket socket(net::make_strand(context));
+        if (!ec) socket.assign(protocol, native, ec);
+        if (ec) {
+            if (debug_) REPEATER_LOG(warn, "[Server Session] Hand-off error: {}", ec.message());
+            on_leave_(shared_from_this());
+            return;
+        }
+        auto session = std::make_shared<WebSocketSession>(std::move(socket), id_, on_upgrade_, on_open_, on_leave_,
+                                                          on_message_, pool_, socket_profile_, debug_);
+        session->tier_ = tier_;
+        session->deflate_response_ = std::move(deflate_response_);
+        session->upgrade_request_ = std::move(upgrade_request_);
+        session->buffer_ = std::move(buffer_);
+        if (debug_) REPEATER_LOG(debug, "[Server Session] Session {} handed off to its tier's executor.", id_);
+        net::dispatch(session->stream_.get_executor(),
+            beast::bind_front_handler(&WebSocketSession::accept_upgrade, session));
+    }
+
+    void accept_upgrade() {
+        stream_.expires_after(handshake_timeout);
+        handshake_.emplace(stream_);
+        handshake_->set_option(websocket::stream_base::decorator(
+            [extensions = deflate_response_](websocket::response_type& res) {
                 res.set(http::field::server, std::string(BOOST_BEAST_VERSION_STRING) + " websocket-server-async");
+                // Beast自己的permessage-deflate未启用，它只会原样带上这里设置的头
+                if (!extensions.empty()) res.set(http::field::sec_websocket_extensions, extensions);
             }));
-        ws_.async_accept(beast::bind_front_handler(&WebSocketSession::on_accept, shared_from_this()));
+        handshake_->async_accept(upgrade_request_,
+            beast::bind_front_handler(&WebSocketSession::on_accept, shared_from_this()));
     }
 
     void on_accept(beast::error_code ec) {
+        handshake_.reset();
+        auto const request = std::move(upgrade_request_);
         if (ec) {
-            if (debug_) std::cerr << "[Server Session] Accept error: " << ec.message() << std::endl;
+            if (debug_) REPEATER_LOG(warn, "[Server Session] Accept error: {}", ec.message());
+            on_leave_(shared_from_this());
             return;
         }
-        do_read();
+        stream_.expires_never();
+        last_read_ = std::chrono::steady_clock::now();
+        start_idle_timer();
+        // 握手完成后才加入广播，升级请求的target中可以带续传参数
+        on_open_(shared_from_this(), std::string_view(request.target().data(), request.target().size()));
+        // 升级请求之后已经读到的字节属于第一个客户端帧
+        if (process_frames()) {
+            do_read();
+        }
     }
 
+    /**
+     * @brief 会话是否收到origin所在流的消息，可以从任意线程调用。
+     */
+    bool wants(const ForwardedMessage& origin) {
+        if (!filtered_.load(std::memory_order_acquire)) return true;
+        std::lock_guard<std::mutex> lock(filter_mutex_);
+        if (origin.stream_index >= decisions_.size()) decisions_.resize(origin.stream_index + 1, 0);
+        auto& decision = decisions_[origin.stream_index];
+        if (decision == 0) {
+            bool const match = std::any_of(selectors_.begin(), selectors_.end(), [&](auto const& selector) {
+                return selector.matches(origin.channel, origin.inst_id);
+            });
+            decision = match ? 1 : 2;
+        }
+        return decision == 1;
+    }
+
+    /**
+     * @brief 应用一次请求带来的订阅变化。同一个流重复订阅只记一次，与上游引用计数一致。
+     */
+    void update_filter(const std::vector<StreamSelector>& subscribed, const std::vector<StreamSelector>& unsubscribed) {
+        if (subscribed.empty() && unsubscribed.empty()) return;
+        std::lock_guard<std::mutex> lock(filter_mutex_);
+        for (auto const& selector : subscribed) {
+            if (std::find(selectors_.begin(), selectors_.end(), selector) == selectors_.end()) selectors_.push_back(selector);
+        }
+        for (auto const& selector : unsubscribed) {
+            selectors_.erase(std::remove(selectors_.begin(), selectors_.end(), selector), selectors_.end());
+        }
+        decisions_.clear();
+        // 只退订过的会话仍然收到全部消息；一旦订阅过，退订掉所有流后什么都不再收到
+        if (!subscribed.empty()) filtered_.store(true, std::memory_order_release);
+    }
+
+    void send(MessagePtr const& msg) {
+        if (msg->trace_id()) trace::record(trace::Stage::enqueue, msg->trace_id(), static_cast<std::uint32_t>(id_), trace::now());
+        {
+            std::lock_guard<std::mutex> lock(inbox_mutex_);
+            inbox_.push_back(msg);
+            if (drain_scheduled_) return;
+            drain_scheduled_ = true;
+        }
+        net::post(stream_.get_executor(), make_alloc_handler(write_memory_,
+            beast::bind_front_handler(&WebSocketSession::on_drain, shared_from_this())));
+    }
+
+private:
     void do_read() {
-        ws_.async_read(buffer_, beast::bind_front_handler(&WebSocketSession::on_read, shared_from_this()));
+        stream_.async_read_some(buffer_.prepare(read_chunk), make_alloc_handler(read_memory_,
+            beast::bind_front_handler(&WebSocketSession::on_read, shared_from_this())));
     }
 
-    void on_read(beast::error_code ec, std::size_t) {
-        if (ec == websocket::error::closed) {
-            on_leave_(shared_from_this());
+    void on_read(beast::error_code ec, std::size_t bytes_transferred) {
+        if (ec) {
+            if (debug_ && ec != net::error::eof) REPEATER_LOG(warn, "[Server Session] Read error: {}", ec.message());
+            leave();
             return;
         }
-        if (ec) {
-            if (debug_) std::cerr << "[Server Session] Read error: " << ec.message() << std::endl;
-            on_leave_(shared_from_this());
+        last_read_ = std::chrono::steady_clock::now();
+        buffer_.commit(bytes_transferred);
+        rearm_quickack(stream_.socket(), socket_profile_);
+        if (process_frames()) {
+            do_read();
+        }
+    }
+
+    // 与Beast的服务端建议配置一致：idle_timeout内没有收到任何数据则断开
+    void start_idle_timer() {
+        idle_timer_.expires_at(last_read_ + idle_timeout);
+        idle_timer_.async_wait(beast::bind_front_handler(&WebSocketSession::on_idle_timer, shared_from_this()));
+    }
+
+    void on_idle_timer(beast::error_code ec) {
+        if (ec) return;
+        if (std::chrono::steady_clock::now() - last_read_ < idle_timeout) {
+            start_idle_timer();
             return;
         }
-        buffer_.consume(buffer_.size());
-        do_read();
+        if (debug_) REPEATER_LOG(warn, "[Server Session] Idle timeout.");
+        // 关闭socket使未完成的读写以错误结束，由它们离开服务器
+        beast::error_code ignored;
+        stream_.socket().close(ignored);
     }
 
-    void send(std::shared_ptr<const std::string> const& ss) {
-        net::post(ws_.get_executor(),
-            beast::bind_front_handler(&WebSocketSession::on_send, shared_from_this(), ss));
+    void leave() {
+        idle_timer_.cancel();
+        on_leave_(shared_from_this());
     }
 
-private:
-    void on_send(std::shared_ptr<const std::string> const& ss) {
-        queue_.push_back(ss);
-        if (queue_.size() > 1) return;
-        do_write();
+    /**
+     * @brief 处理缓冲区中所有完整的帧。
+     * @return false表示会话正在关闭，不再继续读
+     */
+    bool process_frames() {
+        for (;;) {
+            auto const data = buffer_.data();
+            ws_frame::Frame frame;
+            std::size_t consumed = 0;
+            auto const result = ws_frame::parse_client_frame(static_cast<char*>(data.data()), data.size(),
+                                                             max_client_message, frame, consumed);
+            if (result == ws_frame::ParseResult::need_more) return true;
+            if (result == ws_frame::ParseResult::protocol_error) return close(1002);
+            if (result == ws_frame::ParseResult::too_large) return close(1009);
+            bool const keep_reading = on_frame(frame);
+            buffer_.consume(consumed);
+            if (!keep_reading) return false;
+        }
+    }
+
+    bool on_frame(ws_frame::Frame const& frame) {
+        // 保留位先于操作码检查，控制帧同样适用。RSV2/RSV3已由parse_client_frame拒绝；
+        // RSV1只能出现在协商了permessage-deflate的会话中，并且只在一条数据消息的第一帧上
+        bool const continuation = frame.opcode == ws_frame::Opcode::continuation;
+        if (frame.rsv1 && (!deflate() || continuation || ws_frame::is_control(frame.opcode))) {
+            return close(1002);
+        }
+        switch (frame.opcode) {
+            case ws_frame::Opcode::ping:
+                enqueue(pool_.acquire(frame.payload, ws_frame::Opcode::pong));
+                return true;
+            case ws_frame::Opcode::pong:
+                return true;
+            case ws_frame::Opcode::close:
+                if (!ws_frame::is_valid_close_payload(frame.payload)) return close(1002);
+                // 回显对方的状态码后关闭
+                enqueue_close(pool_.acquire(frame.payload.substr(0, std::min<std::size_t>(frame.payload.size(), 2)),
+                                            ws_frame::Opcode::close));
+                return false;
+            default:
+                break;
+        }
+        if (fragmented_ != continuation) return close(1002);
+        if (!continuation) compressed_ = frame.rsv1;
+        // 下游的请求(例如订阅)不在热路径上，交给服务器的handler处理
+        if (!fragmented_ && frame.fin) {
+            return deliver(frame.payload);
+        }
+        if (fragments_.size() + frame.payload.size() > max_client_message) {
+            return close(1009);
+        }
+        fragments_.append(frame.payload);
+        fragmented_ = !frame.fin;
+        if (frame.fin) {
+            bool const keep_reading = deliver(fragments_);
+            fragments_.clear();
+            return keep_reading;
+        }
+        return true;
+    }
+
+    bool deliver(std::string_view message) {
+        if (compressed_) {
+            // 解压后的长度同样受max_client_message限制
+            if (!permessage_deflate::decompress(message, max_client_message, inflated_)) return close(1007);
+            message = inflated_;
+        }
+        on_message_(shared_from_this(), message);
+        return true;
+    }
+
+    bool close(std::uint16_t code) {
+        if (debug_) REPEATER_LOG(warn, "[Server Session] Closing with code {}", code);
+        char const payload[2] = {static_cast<char>(code >> 8), static_cast<char>(code & 0xFF)};
+        enqueue_close(pool_.acquire(std::string_view(payload, sizeof(payload)), ws_frame::Opcode::close));
+        return false;
+    }
+
+    void enqueue(MessagePtr msg) {
+        if (closing_) return;
+        queue_.push_back(std::move(msg));
+        if (!writing_) do_write();
+    }
+
+    void enqueue_close(MessagePtr msg) {
+        if (closing_) return;
+        enqueue(std::move(msg));
+        closing_ = true;
+    }
+
+    void on_drain() {
+        {
+            std::lock_guard<std::mutex> lock(inbox_mutex_);
+            drain_scheduled_ = false;
+            if (closing_) {
+                inbox_.clear();
+                return;
+            }
+            if (queue_.empty()) {
+                queue_.swap(inbox_);
+            } else {
+                queue_.insert(queue_.end(), inbox_.begin(), inbox_.end());
+                inbox_.clear();
+            }
+        }
+        if (!writing_ && write_index_ < queue_.size()) {
+            do_write();
+        }
     }
 
     void do_write() {
-        ws_.async_write(net::buffer(*queue_.front()),
-            beast::bind_front_handler(&WebSocketSession::on_write, shared_from_this()));
+        writing_ = true;
+        iovec_count_ = std::min(queue_.size() - write_index_, max_write_batch);
+        for (std::size_t i = 0; i < iovec_count_; ++i) {
+            auto const frame = queue_[write_index_ + i]->frame();
+            iovecs_[i] = net::const_buffer(frame.data(), frame.size());
+        }
+        net::async_write(stream_, BufferView{iovecs_.data(), iovecs_.data() + iovec_count_},
+            make_alloc_handler(write_memory_,
+                beast::bind_front_handler(&WebSocketSession::on_write, shared_from_this())));
     }
 
     void on_write(beast::error_code ec, std::size_t) {
+        writing_ = false;
         if (ec) {
-            if (debug_) std::cerr << "[Server Session] Write error: " << ec.message() << std::endl;
-            on_leave_(shared_from_this());
+            if (debug_) REPEATER_LOG(warn, "[Server Session] Write error: {}", ec.message());
+            leave();
             return;
         }
-        queue_.erase(queue_.begin());
-        if (!queue_.empty()) {
+        auto const tsc = trace::now();
+        for (std::size_t i = 0; i < iovec_count_; ++i) {
+            auto& msg = queue_[write_index_ + i];
+            if (msg->trace_id()) trace::complete(msg->trace_id(), msg->trace_start(), static_cast<std::uint32_t>(id_), tsc);
+            msg.reset();
+        }
+        write_index_ += iovec_count_;
+        if (write_index_ < queue_.size()) {
             do_write();
+            return;
+        }
+        queue_.clear();
+        write_index_ = 0;
+        if (closing_) {
+            beast::error_code ignored;
+            stream_.socket().shutdown(tcp::socket::shutdown_send, ignored);
+            leave();
         }
     }
 };
 
-WebSocketServer::WebSocketServer(net::io_context& ioc, tcp::endpoint endpoint, bool debug)
-    : ioc_(ioc), acceptor_(ioc), debug_(debug) {
+WebSocketServer::WebSocketServer(net::io_context& ioc, tcp::endpoint endpoint, const SocketProfile& socket_profile,
+                                 MessagePool& pool, std::size_t replay_depth, bool debug)
+    : ioc_(ioc), acceptor_(ioc), socket_profile_(socket_profile), pool_(pool), debug_(debug), replay_(replay_depth),
+      snapshot_(std::make_shared<const SessionList>()), tiers_{SessionTier{"default", nullptr}} {
     beast::error_code ec;
     acceptor_.open(endpoint.protocol(), ec);
     if (ec) {
-        std::cerr << "[Server] Open error: " << ec.message() << std::endl;
+        REPEATER_LOG(error, "[Server] Open error: {}", ec.message());
         return;
     }
     acceptor_.set_option(net::socket_base::reuse_address(true), ec);
     if (ec) {
-        std::cerr << "[Server] Set option error: " << ec.message() << std::endl;
+        REPEATER_LOG(error, "[Server] Set option error: {}", ec.message());
         return;
     }
+    // 缓冲区大小需要在listen之前设置，才能影响握手时的窗口缩放因子，并被接受的socket继承
+    SocketProfile listen_profile;
+    listen_profile.tcp_nodelay = false;
+    listen_profile.rcvbuf = socket_profile_.rcvbuf;
+    listen_profile.sndbuf = socket_profile_.sndbuf;
+    apply_socket_profile(acceptor_.native_handle(), listen_profile, "Server");
     acceptor_.bind(endpoint, ec);
     if (ec) {
-        std::cerr << "[Server] Bind error: " << ec.message() << std::endl;
+        REPEATER_LOG(error, "[Server] Bind error: {}", ec.message());
         return;
     }
     acceptor_.listen(net::socket_base::max_listen_connections, ec);
     if (ec) {
-        std::cerr << "[Server] Listen error: " << ec.message() << std::endl;
+        REPEATER_LOG(error, "[Server] Listen error: {}", ec.message());
         return;
     }
 }
 
+tcp::endpoint WebSocketServer::local_endpoint() const {
+    beast::error_code ec;
+    return acceptor_.local_endpoint(ec);
+}
+
 void WebSocketServer::run() {
-    if (debug_) std::cout << "[Server] Started listening on " << acceptor_.local_endpoint() << std::endl;
+    if (debug_) {
+        auto const endpoint = acceptor_.local_endpoint();
+        REPEATER_LOG(debug, "[Server] Started listening on {}:{}", endpoint.address().to_string(), endpoint.port());
+    }
     do_accept();
 }
 
@@ -132,49 +524,251 @@ void WebSocketServer::do_accept() {
         beast::bind_front_handler(&WebSocketServer::on_accept, shared_from_this()));
 }
 
-void WebSocketServer::on_accept(beast::error_code ec, tcp::socket socket) {
+void WebSocketServer::on_accept(beast::error_code ec, strand_socket socket) {
     if (ec) {
-        std::cerr << "[Server] Accept error: " << ec.message() << std::endl;
+        REPEATER_LOG(error, "[Server] Accept error: {}", ec.message());
     } else {
+        auto on_upgrade_cb = [this](std::shared_ptr<WebSocketSession> session,
+                                    const http::request<http::string_body>& request) -> net::io_context* {
+            auto const target = request.target();
+            auto const header = request["X-Repeater-Tier"];
+            auto const tier = select_tier(std::string_view(target.data(), target.size()),
+                                          std::string_view(header.data(), header.size()));
+            session->set_tier(tier);
+            auto const offers = request[http::field::sec_websocket_extensions];
+            if (auto response = permessage_deflate::negotiate(std::string_view(offers.data(), offers.size()), compression_)) {
+                session->enable_deflate(std::move(*response));
+            }
+            return tiers_[tier].context;
+        };
+        auto on_open_cb = [this](std::shared_ptr<WebSocketSession> session, std::string_view target) {
+            this->join(session, target);
+        };
         auto on_leave_cb = [this](std::shared_ptr<WebSocketSession> session) {
             this->leave(session);
         };
-        auto session = std::make_shared<WebSocketSession>(std::move(socket), on_leave_cb, debug_);
-        join(session);
+        auto on_message_cb = [this](std::shared_ptr<WebSocketSession> session, std::string_view message) {
+            this->on_session_message(session, message);
+        };
+        auto session = std::make_shared<WebSocketSession>(std::move(socket), ++next_session_id_,
+            on_upgrade_cb, on_open_cb, on_leave_cb, on_message_cb, pool_, socket_profile_, debug_);
         session->run();
     }
     do_accept();
 }
 
-void WebSocketServer::join(std::shared_ptr<WebSocketSession> session) {
+void WebSocketServer::set_tiers(std::vector<SessionTier> tiers, std::size_t default_tier) {
+    if (tiers.empty()) return;
+    tiers_ = std::move(tiers);
+    default_tier_ = std::min(default_tier, tiers_.size() - 1);
+}
+
+std::size_t WebSocketServer::select_tier(std::string_view target, std::string_view header) const {
+    // 头部优先；否则取路径的第一段，"/"或不是层级名的路径(兼容已有客户端的任意路径)归入默认层级
+    auto name = header;
+    if (name.empty()) {
+        auto path = target.substr(0, target.find('?'));
+        while (!path.empty() && path.front() == '/') path.remove_prefix(1);
+        name = path.substr(0, path.find('/'));
+    }
+    if (name.empty()) return default_tier_;
+    for (std::size_t i = 0; i < tiers_.size(); ++i) {
+        if (tiers_[i].name == name) return i;
+    }
+    if (debug_ && !header.empty()) {
+        REPEATER_LOG(warn, "[Server] Unknown tier '{}', using '{}'.", name, tiers_[default_tier_].name);
+    }
+    return default_tier_;
+}
+
+std::vector<WebSocketServer::ResumeRequest> WebSocketServer::parse_resume_requests(std::string_view target) {
+    std::vector<ResumeRequest> requests;
+    auto const query = target.find('?');
+    if (query == std::string_view::npos) return requests;
+
+    // resume=<channel>:<instId>:<key>[,<channel>:<instId>:<key>...]，key是该流去重策略使用的seqId/tradeId/ts
+    for (auto params = target.substr(query + 1); !params.empty();) {
+        auto const amp = params.find('&');
+        auto const param = params.substr(0, amp);
+        params = amp == std::string_view::npos ? std::string_view{} : params.substr(amp + 1);
+        if (param.rfind("resume=", 0) != 0) continue;
+
+        auto const value = percent_decode(param.substr(7));
+        std::string_view items = value;
+        while (!items.empty()) {
+            auto const comma = items.find(',');
+            auto const item = items.substr(0, comma);
+            items = comma == std::string_view::npos ? std::string_view{} : items.substr(comma + 1);
+            auto const first = item.find(':');
+            auto const last = item.rfind(':');
+            if (first == std::string_view::npos || first == last) continue;
+            try {
+                requests.push_back(ResumeRequest{std::string(item.substr(0, first)),
+                                                 std::string(item.substr(first + 1, last - first - 1)),
+                                                 std::stoll(std::string(item.substr(last + 1)))});
+            } catch (const std::exception&) {
+                // key不是整数，忽略这一项
+            }
+        }
+    }
+    return requests;
+}
+
+void WebSocketServer::join(std::shared_ptr<WebSocketSession> session, std::string_view target) {
+    auto const requests = parse_resume_requests(target);
+    std::vector<ReplayBuffer::Replayed> replayed;
+
+    // 在广播锁内收集续传消息并加入会话：锁之前转发的消息都在replay_中，之后转发的都会直接广播给它，
+    // 续传的消息排在会话收件箱中所有实时消息之前，既不丢也不重
     std::lock_guard<std::mutex> lock(sessions_mutex_);
+    for (auto const& request : requests) {
+        auto const result = replay_.collect(request.channel, request.inst_id, request.after, replayed);
+        nlohmann::json const reply = {
+            {"event", "resume"},
+            {"arg", {{"channel", request.channel}, {"instId", request.inst_id}}},
+            {"after", request.after},
+            {"replayed", result.replayed},
+            {"complete", result.complete}};
+        session->send(pool_.acquire(reply.dump()));
+        if (debug_) {
+            REPEATER_LOG(debug, "[Server] Session {} resumes {}:{} after {}, replaying {}{}", session->id(),
+                         request.channel, request.inst_id, request.after, result.replayed,
+                         result.complete ? "" : " (incomplete)");
+        }
+    }
+    // 多个流的续传按当时的转发顺序交错
+    std::sort(replayed.begin(), replayed.end(),
+              [](auto const& a, auto const& b) { return a.order < b.order; });
+    for (auto const& entry : replayed) {
+        session->send(entry.message);
+    }
+
     sessions_.insert(session);
-    if (debug_) std::cout << "[Server] Client joined. Total clients: " << sessions_.size() << std::endl;
+    rebuild_snapshot();
+    if (debug_) {
+        REPEATER_LOG(debug, "[Server] Client joined tier '{}'. Total clients: {}", tiers_[session->tier()].name,
+                     sessions_.size());
+    }
 }
 
 void WebSocketServer::leave(std::shared_ptr<WebSocketSession> session) {
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        // 读和写可能同时失败，会话只离开一次
+        if (sessions_.erase(session) == 0) return;
+        rebuild_snapshot();
+        if (debug_) REPEATER_LOG(debug, "[Server] Client left. Total clients: {}", sessions_.size());
+    }
+    if (on_session_close_) on_session_close_(session->id());
+}
+
+void WebSocketServer::set_session_handlers(SessionMessageHandler on_message, SessionCloseHandler on_close) {
+    on_session_message_ = std::move(on_message);
+    on_session_close_ = std::move(on_close);
+}
+
+void WebSocketServer::on_session_message(std::shared_ptr<WebSocketSession> session, std::string_view message) {
+    if (!on_session_message_) return;
+    auto const response = on_session_message_(session->id(), message);
+    // 先更新过滤再回复：客户端收到subscribe事件之后收到的就是过滤后的消息
+    session->update_filter(response.subscribed, response.unsubscribed);
+    for (auto const& reply : response.replies) {
+        session->send(pool_.acquire(reply));
+    }
+}
+
+void WebSocketServer::rebuild_snapshot() {
+    // 调用方持有sessions_mutex_。按层级排序，同一层级内按加入的先后(会话id)，不依赖哈希顺序
+    auto sessions = std::make_shared<SessionList>(sessions_.begin(), sessions_.end());
+    std::sort(sessions->begin(), sessions->end(), [](auto const& a, auto const& b) {
+        return a->tier() != b->tier() ? a->tier() < b->tier() : a->id() < b->id();
+    });
+    snapshot_ = std::move(sessions);
+}
+
+std::vector<std::size_t> WebSocketServer::tier_session_counts() {
     std::lock_guard<std::mutex> lock(sessions_mutex_);
-    sessions_.erase(session);
-    if (debug_) std::cout << "[Server] Client left. Total clients: " << sessions_.size() << std::endl;
+    std::vector<std::size_t> counts(tiers_.size(), 0);
+    for (auto const& session : sessions_) ++counts[session->tier()];
+    return counts;
+}
+
+std::size_t WebSocketServer::session_count() {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    return sessions_.size();
 }
 
 void WebSocketServer::broadcast(std::string_view message) {
-    auto const shared_msg = std::make_shared<const std::string>(message);
-    
-    std::vector<std::weak_ptr<WebSocketSession>> v;
+    // 整条消息只拷贝一次到池化缓冲区，所有会话共享同一份引用计数的内存
+    broadcast(pool_.acquire(message));
+}
+
+void WebSocketServer::broadcast(MessagePtr const& message) {
+    std::shared_ptr<const SessionList> sessions;
     {
         std::lock_guard<std::mutex> lock(sessions_mutex_);
-        v.reserve(sessions_.size());
-        for (auto session : sessions_) {
-            v.emplace_back(session);
-        }
+        sessions = snapshot_;
     }
+    fan_out(*sessions, message, nullptr);
+}
 
-    for (auto const& weak_session : v) {
-        if (auto session = weak_session.lock()) {
-            session->send(shared_msg);
+void WebSocketServer::broadcast(MessagePtr const& message, const ForwardedMessage& origin) {
+    std::shared_ptr<const SessionList> sessions;
+    {
+        // 锁内只做记录和取快照：记录时分配的order决定一条消息对正在加入的会话是续传还是实时投递，
+        // 两者只会发生其一；join按order合并续传。投递和压缩在锁外进行，各组的广播互不等待
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        replay_.append(origin.stream_index, origin.channel, origin.inst_id, origin.key, message);
+        sessions = snapshot_;
+    }
+    fan_out(*sessions, message, &origin);
+}
+
+void WebSocketServer::fan_out(const SessionList& sessions, MessagePtr const& message, const ForwardedMessage* origin) {
+    // 先投递所有未压缩的会话，它们不等待zlib；之后生成一次压缩帧，由所有压缩会话共享。
+    // 两组内部各自保持快照(层级)顺序，没有需要这条消息的压缩会话时不压缩
+    bool deflate_sessions = false;
+    for (auto const& session : sessions) {
+        if (origin && !session->wants(*origin)) continue;
+        if (session->deflate()) {
+            deflate_sessions = true;
+            continue;
         }
+        session->send(message);
+    }
+    if (!deflate_sessions) return;
+    auto const compressed = compress(message);
+    for (auto const& session : sessions) {
+        if (session->deflate() && (!origin || session->wants(*origin))) session->send(compressed ? compressed : message);
+    }
+}
+
+MessagePtr WebSocketServer::compress(MessagePtr const& message) {
+    if (message->size() < compression_.min_size) return {};
+    thread_local std::string deflated;
+    if (!permessage_deflate::compress(message->view(), compression_, deflated)) return {};
+    compressed_messages_.fetch_add(1, std::memory_order_relaxed);
+    compressed_in_bytes_.fetch_add(message->size(), std::memory_order_relaxed);
+    compressed_out_bytes_.fetch_add(deflated.size(), std::memory_order_relaxed);
+    // 压缩帧与原消息使用同一个池，一组上游的突发不会占用其它组的槽位
+    auto& pool = message->pool() ? *message->pool() : pool_;
+    return pool.acquire(deflated, ws_frame::Opcode::text, true);
+}
+
+void WebSocketServer::set_compression(const permessage_deflate::Options& options) {
+    compression_ = options;
+}
+
+WebSocketServer::CompressionStats WebSocketServer::compression_stats() {
+    CompressionStats stats;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        for (auto const& session : sessions_) stats.sessions += session->deflate() ? 1 : 0;
     }
+    stats.messages = compressed_messages_.load(std::memory_order_relaxed);
+    stats.bytes_in = compressed_in_bytes_.load(std::memory_order_relaxed);
+    stats.bytes_out = compressed_out_bytes_.load(std::memory_order_relaxed);
+    return stats;
 }
 
-} // namespace repeater
\ No newline at end of file
+} // namespace repeater
@@ -0,0 +1,33 @@
+#ifndef REPEATER_TESTS_CHECK_HPP
+#define REPEATER_TESTS_CHECK_HPP
+
+#include <cstdio>
+
+/**
+ * 测试用的最小断言：失败时打印位置并计数，main最后以失败数作为退出码，ctest据此判定结果。
+ */
+inline int& check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(expr)                                                                  \
+    do {                                                                             \
+        if (!(expr)) {                                                               \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+            ++check_failures();                                                      \
+        }                                                                            \
+    } while (0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+
+inline int check_result(const char* name) {
+    if (check_failures() == 0) {
+        std::printf("%s: all checks passed\n", name);
+        return 0;
+    }
+    std::fprintf(stderr, "%s: %d check(s) failed\n", name, check_failures());
+    return 1;
+}
+
+#endif // REPEATER_TESTS_CHECK_HPP
@@ -0,0 +1,220 @@
+#include "repeater/ws_frame.hpp"
+#include "check.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+using namespace repeater;
+using ws_frame::Opcode;
+using ws_frame::ParseResult;
+
+namespace {
+
+enum class LengthEncoding { minimal, bits16, bits64 };
+
+struct FrameSpec {
+    Opcode opcode = Opcode::text;
+    bool fin = true;
+    std::uint8_t rsv = 0;  // 0x40/0x20/0x10
+    bool masked = true;
+    LengthEncoding encoding = LengthEncoding::minimal;
+};
+
+// 按客户端的方式编码一帧，payload用固定掩码加掩
+std::string client_frame(std::string_view payload, FrameSpec spec = {}) {
+    std::string out;
+    out.push_back(static_cast<char>((spec.fin ? 0x80 : 0) | spec.rsv | static_cast<std::uint8_t>(spec.opcode)));
+    auto const mask_bit = spec.masked ? 0x80 : 0;
+    auto const size = static_cast<std::uint64_t>(payload.size());
+    auto encoding = spec.encoding;
+    if (encoding == LengthEncoding::minimal) {
+        encoding = size < 126 ? LengthEncoding::minimal : size <= 0xFFFF ? LengthEncoding::bits16 : LengthEncoding::bits64;
+    }
+    if (encoding == LengthEncoding::minimal) {
+        out.push_back(static_cast<char>(mask_bit | size));
+    } else if (encoding == LengthEncoding::bits16) {
+        out.push_back(static_cast<char>(mask_bit | 126));
+        out.push_back(static_cast<char>(size >> 8));
+        out.push_back(static_cast<char>(size));
+    } else {
+        out.push_back(static_cast<char>(mask_bit | 127));
+        for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>(size >> (56 - 8 * i)));
+    }
+    unsigned char const mask[4] = {0x12, 0x9A, 0x5C, 0xE3};
+    if (spec.masked) out.append(reinterpret_cast<const char*>(mask), 4);
+    for (std::size_t i = 0; i < payload.size(); ++i) {
+        out.push_back(spec.masked ? static_cast<char>(payload[i] ^ mask[i & 3]) : payload[i]);
+    }
+    return out;
+}
+
+struct Parsed {
+    ParseResult result;
+    ws_frame::Frame frame;
+    std::size_t consumed = 0;
+};
+
+Parsed parse(std::string& bytes, std::size_t max_payload = 64 * 1024) {
+    Parsed parsed{};
+    parsed.result = ws_frame::parse_client_frame(bytes.data(), bytes.size(), max_payload, parsed.frame, parsed.consumed);
+    return parsed;
+}
+
+std::string pattern(std::size_t size) {
+    std::string out(size, '\0');
+    for (std::size_t i = 0; i < size; ++i) out[i] = static_cast<char>('a' + i % 26);
+    return out;
+}
+
+void test_masked_lengths() {
+    // 7位、16位和64位长度的边界值，payload都应原样去掉掩码
+    for (std::size_t size : {std::size_t{0}, std::size_t{1}, std::size_t{125}, std::size_t{126},
+                             std::size_t{0xFFFF}, std::size_t{0x10000}, std::size_t{70000}}) {
+        auto const payload = pattern(size);
+        auto bytes = client_frame(payload);
+        auto const parsed = parse(bytes, 128 * 1024);
+        CHECK(parsed.result == ParseResult::frame);
+        CHECK(parsed.frame.opcode == Opcode::text);
+        CHECK(parsed.frame.fin);
+        CHECK(!parsed.frame.rsv1);
+        CHECK_EQ(parsed.frame.payload, payload);
+        CHECK_EQ(parsed.consumed, bytes.size());
+    }
+}
+
+void test_unmasked_rejected() {
+    auto bytes = client_frame("hello", {.masked = false});
+    CHECK(parse(bytes).result == ParseResult::protocol_error);
+}
+
+void test_need_more() {
+    // 截断在帧头、扩展长度、掩码和payload中的每一个位置都应等待更多数据
+    for (std::size_t size : {std::size_t{5}, std::size_t{300}, std::size_t{70000}}) {
+        auto const full = client_frame(pattern(size));
+        for (std::size_t cut = 0; cut < full.size(); cut += (cut < 16 ? 1 : 997)) {
+            auto bytes = full.substr(0, cut);
+            CHECK(parse(bytes, 128 * 1024).result == ParseResult::need_more);
+        }
+    }
+}
+
+void test_back_to_back_frames() {
+    auto bytes = client_frame("first") + client_frame("second", {.opcode = Opcode::binary});
+    auto const first = parse(bytes);
+    CHECK(first.result == ParseResult::frame);
+    CHECK_EQ(first.frame.payload, "first");
+    auto rest = bytes.substr(first.consumed);
+    auto const second = parse(rest);
+    CHECK(second.result == ParseResult::frame);
+    CHECK(second.frame.opcode == Opcode::binary);
+    CHECK_EQ(second.frame.payload, "second");
+    CHECK_EQ(second.consumed, rest.size());
+}
+
+void test_non_minimal_length_rejected() {
+    auto short16 = client_frame("hello", {.encoding = LengthEncoding::bits16});
+    CHECK(parse(short16).result == ParseResult::protocol_error);
+    auto short64 = client_frame(pattern(300), {.encoding = LengthEncoding::bits64});
+    CHECK(parse(short64).result == ParseResult::protocol_error);
+    auto exact16 = client_frame(pattern(126), {.encoding = LengthEncoding::bits16});
+    CHECK(parse(exact16).result == ParseResult::frame);
+
+    // 64位长度的最高位必须为0，即使max_payload不限制
+    std::string huge = {static_cast<char>(0x81), static_cast<char>(0x80 | 127)};
+    huge.push_back(static_cast<char>(0x80));
+    huge.append(7, '\0');
+    CHECK(parse(huge, ~std::size_t{0}).result == ParseResult::protocol_error);
+}
+
+void test_too_large() {
+    // 帧头到齐即判定，不必等payload
+    auto bytes = client_frame(pattern(1025)).substr(0, 8);
+    CHECK(parse(bytes, 1024).result == ParseResult::too_large);
+    auto at_limit = client_frame(pattern(1024));
+    CHECK(parse(at_limit, 1024).result == ParseResult::frame);
+}
+
+void test_reserved_bits() {
+    // RSV1留给permessage-deflate由会话判断；RSV2/RSV3没有协商任何扩展，直接拒绝
+    auto rsv1 = client_frame("x", {.rsv = 0x40});
+    auto const parsed = parse(rsv1);
+    CHECK(parsed.result == ParseResult::frame);
+    CHECK(parsed.frame.rsv1);
+    auto rsv2 = client_frame("x", {.rsv = 0x20});
+    CHECK(parse(rsv2).result == ParseResult::protocol_error);
+    auto rsv3 = client_frame("x", {.rsv = 0x10});
+    CHECK(parse(rsv3).result == ParseResult::protocol_error);
+}
+
+void test_opcodes() {
+    for (int code = 0; code < 16; ++code) {
+        auto const opcode = static_cast<Opcode>(code);
+        bool const defined = code <= 2 || (code >= 8 && code <= 10);
+        auto bytes = client_frame("x", {.opcode = opcode});
+        auto const parsed = parse(bytes);
+        CHECK(parsed.result == (defined ? ParseResult::frame : ParseResult::protocol_error));
+        if (defined) CHECK(parsed.frame.opcode == opcode);
+    }
+}
+
+void test_control_frames() {
+    auto ping = client_frame(pattern(125), {.opcode = Opcode::ping});
+    CHECK(parse(ping).result == ParseResult::frame);
+    auto long_ping = client_frame(pattern(126), {.opcode = Opcode::ping});
+    CHECK(parse(long_ping).result == ParseResult::protocol_error);
+    auto fragmented_close = client_frame("", {.opcode = Opcode::close, .fin = false});
+    CHECK(parse(fragmented_close).result == ParseResult::protocol_error);
+    auto fragmented_text = client_frame("part", {.fin = false});
+    auto const parsed = parse(fragmented_text);
+    CHECK(parsed.result == ParseResult::frame);
+    CHECK(!parsed.frame.fin);
+}
+
+void test_close_payload() {
+    auto const payload = [](std::uint16_t code) {
+        return std::string{static_cast<char>(code >> 8), static_cast<char>(code & 0xFF)};
+    };
+    CHECK(ws_frame::is_valid_close_payload(""));
+    CHECK(!ws_frame::is_valid_close_payload(std::string(1, '\x03')));
+    for (std::uint16_t code : {1000, 1001, 1002, 1003, 1007, 1008, 1009, 1010, 1011, 1012, 1013, 1014, 3000, 4999}) {
+        CHECK(ws_frame::is_valid_close_payload(payload(code)));
+        CHECK(ws_frame::is_valid_close_payload(payload(code) + "reason"));
+    }
+    for (std::uint16_t code : {0, 999, 1004, 1005, 1006, 1015, 1016, 2999, 5000, 0xFFFF}) {
+        CHECK(!ws_frame::is_valid_close_payload(payload(code)));
+    }
+}
+
+void test_encode_header() {
+    unsigned char header[ws_frame::max_header_size];
+    CHECK_EQ(ws_frame::encode_header(header, Opcode::text, 125), 2u);
+    CHECK_EQ(header[0], 0x81);
+    CHECK_EQ(header[1], 125);
+    CHECK_EQ(ws_frame::encode_header(header, Opcode::text, 126, true, true), 4u);
+    CHECK_EQ(header[0], 0xC1);
+    CHECK_EQ(header[1], 126);
+    CHECK_EQ((header[2] << 8 | header[3]), 126);
+    CHECK_EQ(ws_frame::encode_header(header, Opcode::binary, 0x10000, false), 10u);
+    CHECK_EQ(header[0], 0x02);
+    CHECK_EQ(header[1], 127);
+    CHECK_EQ(header[7], 1);
+    CHECK_EQ(header[8], 0);
+}
+
+} // namespace
+
+int main() {
+    test_masked_lengths();
+    test_unmasked_rejected();
+    test_need_more();
+    test_back_to_back_frames();
+    test_non_minimal_length_rejected();
+    test_too_large();
+    test_reserved_bits();
+    test_opcodes();
+    test_control_frames();
+    test_close_payload();
+    test_encode_header();
+    return check_result("ws_frame_test");
+}
@@ -0,0 +1,362 @@
+#include "repeater/websocket_server.hpp"
+#include "repeater/message_pool.hpp"
+#include "repeater/ws_frame.hpp"
+#include "check.hpp"
+
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace repeater;
+using ws_frame::Opcode;
+
+namespace {
+
+/**
+ * 阻塞式的测试客户端：手工完成升级请求，按字节构造客户端帧并读取服务端帧。
+ */
+class Client {
+public:
+    struct Frame {
+        std::uint8_t first = 0;  // FIN/RSV/opcode字节
+        std::string payload;
+        bool eof = false;        // 服务端已关闭连接
+
+        Opcode opcode() const { return static_cast<Opcode>(first & 0x0F); }
+        std::uint16_t close_code() const {
+            if (payload.size() < 2) return 0;
+            return static_cast<std::uint16_t>((static_cast<unsigned char>(payload[0]) << 8) |
+                                              static_cast<unsigned char>(payload[1]));
+        }
+    };
+
+    explicit Client(tcp::endpoint endpoint) : socket_(ioc_) {
+        socket_.connect(endpoint);
+        std::string const request =
+            "GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+        net::write(socket_, net::buffer(request));
+        auto const header_end = net::read_until(socket_, net::dynamic_buffer(buffer_), "\r\n\r\n");
+        upgraded_ = buffer_.compare(0, 12, "HTTP/1.1 101") == 0;
+        buffer_.erase(0, header_end);
+    }
+
+    bool upgraded() const { return upgraded_; }
+
+    void send(std::string_view payload, Opcode opcode, bool fin = true, std::uint8_t rsv = 0, bool masked = true) {
+        send_raw(frame(payload, opcode, fin, rsv, masked));
+    }
+
+    void send_raw(std::string const& bytes) {
+        net::write(socket_, net::buffer(bytes));
+    }
+
+    static std::string frame(std::string_view payload, Opcode opcode, bool fin = true, std::uint8_t rsv = 0,
+                             bool masked = true) {
+        std::string out;
+        out.push_back(static_cast<char>((fin ? 0x80 : 0) | rsv | static_cast<std::uint8_t>(opcode)));
+        auto const mask_bit = masked ? 0x80 : 0;
+        auto const size = static_cast<std::uint64_t>(payload.size());
+        if (size < 126) {
+            out.push_back(static_cast<char>(mask_bit | size));
+        } else if (size <= 0xFFFF) {
+            out.push_back(static_cast<char>(mask_bit | 126));
+            out.push_back(static_cast<char>(size >> 8));
+            out.push_back(static_cast<char>(size));
+        } else {
+            out.push_back(static_cast<char>(mask_bit | 127));
+            for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>(size >> (56 - 8 * i)));
+        }
+        char const mask[4] = {'\x37', '\xFA', '\x21', '\x3D'};
+        if (masked) out.append(mask, 4);
+        for (std::size_t i = 0; i < payload.size(); ++i) {
+            out.push_back(masked ? static_cast<char>(payload[i] ^ mask[i & 3]) : payload[i]);
+        }
+        return out;
+    }
+
+    Frame read() {
+        Frame result;
+        if (!fill(2)) return eof();
+        result.first = static_cast<std::uint8_t>(buffer_[0]);
+        std::uint64_t length = static_cast<unsigned char>(buffer_[1]) & 0x7F;
+        std::size_t header = 2;
+        if (length == 126) {
+            if (!fill(4)) return eof();
+            length = (std::uint64_t{static_cast<unsigned char>(buffer_[2])} << 8) | static_cast<unsigned char>(buffer_[3]);
+            header = 4;
+        } else if (length == 127) {
+            if (!fill(10)) return eof();
+            length = 0;
+            for (int i = 0; i < 8; ++i) length = (length << 8) | static_cast<unsigned char>(buffer_[2 + i]);
+            header = 10;
+        }
+        if (!fill(header + length)) return eof();
+        result.payload = buffer_.substr(header, length);
+        buffer_.erase(0, header + length);
+        return result;
+    }
+
+private:
+    bool fill(std::size_t size) {
+        while (buffer_.size() < size) {
+            char chunk[4096];
+            beast::error_code ec;
+            auto const n = socket_.read_some(net::buffer(chunk), ec);
+            if (ec) return false;
+            buffer_.append(chunk, n);
+        }
+        return true;
+    }
+
+    static Frame eof() {
+        Frame result;
+        result.eof = true;
+        return result;
+    }
+
+    net::io_context ioc_;
+    tcp::socket socket_;
+    std::string buffer_;
+    bool upgraded_ = false;
+};
+
+std::string close_payload(std::uint16_t code, std::string_view reason = {}) {
+    std::string out{static_cast<char>(code >> 8), static_cast<char>(code & 0xFF)};
+    out.append(reason);
+    return out;
+}
+
+// 服务端以code关闭，之后不再发送任何帧
+void expect_close(Client& client, std::uint16_t code) {
+    auto const frame = client.read();
+    CHECK(!frame.eof);
+    CHECK(frame.opcode() == Opcode::close);
+    CHECK_EQ(frame.close_code(), code);
+    CHECK(client.read().eof);
+}
+
+void test_echo_lengths(tcp::endpoint endpoint) {
+    Client client(endpoint);
+    CHECK(client.upgraded());
+    for (std::size_t size : {std::size_t{1}, std::size_t{125}, std::size_t{126}, std::size_t{60000}}) {
+        std::string const payload(size, 'm');
+        client.send(payload, Opcode::text);
+        auto const reply = client.read();
+        CHECK(reply.opcode() == Opcode::text);
+        CHECK_EQ(reply.payload, "echo:" + payload);
+    }
+}
+
+void test_fragments_with_interleaved_ping(tcp::endpoint endpoint) {
+    Client client(endpoint);
+    client.send("hel", Opcode::text, false);
+    client.send("p1", Opcode::ping);
+    client.send("lo ", Opcode::continuation, false);
+    client.send("", Opcode::pong);
+    client.send("world", Opcode::continuation, true);
+    auto const pong = client.read();
+    CHECK(pong.opcode() == Opcode::pong);
+    CHECK_EQ(pong.payload, "p1");
+    auto const reply = client.read();
+    CHECK(reply.opcode() == Opcode::text);
+    CHECK_EQ(reply.payload, "echo:hello world");
+
+    // 同一连接上的下一条消息不受之前分片的影响
+    client.send("next", Opcode::text);
+    CHECK_EQ(client.read().payload, "echo:next");
+}
+
+void test_fragment_sequence_errors(tcp::endpoint endpoint) {
+    {
+        Client client(endpoint);
+        client.send("orphan", Opcode::continuation);
+        expect_close(client, 1002);
+    }
+    {
+        Client client(endpoint);
+        client.send("first", Opcode::text, false);
+        client.send("second", Opcode::text);
+        expect_close(client, 1002);
+    }
+    {
+        Client client(endpoint);
+        client.send("", Opcode::ping, false);
+        expect_close(client, 1002);
+    }
+}
+
+void test_protocol_errors(tcp::endpoint endpoint) {
+    {
+        Client client(endpoint);
+        client.send("unmasked", Opcode::text, true, 0, false);
+        expect_close(client, 1002);
+    }
+    {
+        Client client(endpoint);
+        client.send("x", static_cast<Opcode>(0x3));
+        expect_close(client, 1002);
+    }
+    {
+        Client client(endpoint);
+        client.send("x", static_cast<Opcode>(0xB));
+        expect_close(client, 1002);
+    }
+    // 没有协商permessage-deflate，RSV1同样非法；控制帧上的RSV1也不例外
+    for (std::uint8_t rsv : {std::uint8_t{0x40}, std::uint8_t{0x20}, std::uint8_t{0x10}}) {
+        Client client(endpoint);
+        client.send("x", Opcode::text, true, rsv);
+        expect_close(client, 1002);
+    }
+    {
+        Client client(endpoint);
+        client.send("", Opcode::ping, true, 0x40);
+        expect_close(client, 1002);
+    }
+    {
+        Client client(endpoint);
+        client.send(std::string(126, 'p'), Opcode::ping);
+        expect_close(client, 1002);
+    }
+}
+
+void test_oversize(tcp::endpoint endpoint) {
+    {
+        // 只发帧头，服务端不必等payload到齐
+        Client client(endpoint);
+        client.send_raw(Client::frame(std::string(64 * 1024 + 1, 'o'), Opcode::text).substr(0, 14));
+        expect_close(client, 1009);
+    }
+    {
+        // 单帧都不超限，拼接后超限
+        Client client(endpoint);
+        client.send(std::string(40000, 'o'), Opcode::text, false);
+        client.send(std::string(40000, 'o'), Opcode::continuation);
+        expect_close(client, 1009);
+    }
+}
+
+void test_close_handshake(tcp::endpoint endpoint) {
+    {
+        Client client(endpoint);
+        client.send(close_payload(1000, "bye"), Opcode::close);
+        expect_close(client, 1000);
+    }
+    {
+        Client client(endpoint);
+        client.send(close_payload(4001), Opcode::close);
+        expect_close(client, 4001);
+    }
+    {
+        Client client(endpoint);
+        client.send("", Opcode::close);
+        auto const frame = client.read();
+        CHECK(frame.opcode() == Opcode::close);
+        CHECK(frame.payload.empty());
+        CHECK(client.read().eof);
+    }
+    // 1005/1006/1015等只能本地使用的状态码、以及只有1字节的payload都按协议错误处理
+    for (std::uint16_t code : {999, 1004, 1005, 1006, 1015, 5000}) {
+        Client client(endpoint);
+        client.send(close_payload(code), Opcode::close);
+        expect_close(client, 1002);
+    }
+    {
+        Client client(endpoint);
+        client.send(std::string(1, '\x03'), Opcode::close);
+        expect_close(client, 1002);
+    }
+}
+
+// 测试handler把 "sub:<channel>:<instId>" / "unsub:<channel>:<instId>" 当作订阅请求
+SessionResponse handle_request(std::string_view message) {
+    SessionResponse response{{"echo:" + std::string(message)}, {}, {}};
+    auto const colon = message.find(':');
+    auto const last = message.rfind(':');
+    if (colon == std::string_view::npos || colon == last) return response;
+    StreamSelector selector{std::string(message.substr(colon + 1, last - colon - 1)), std::string(message.substr(last + 1))};
+    auto const op = message.substr(0, colon);
+    if (op == "sub") response.subscribed.push_back(selector);
+    if (op == "unsub") response.unsubscribed.push_back(selector);
+    return response;
+}
+
+void publish(WebSocketServer& server, MessagePool& pool, std::string_view channel, std::string_view inst_id,
+             std::size_t stream_index, std::string_view payload) {
+    ForwardedMessage const origin{payload, channel, inst_id, 0, 0, stream_index, -1, payload};
+    server.broadcast(pool.acquire(payload), origin);
+}
+
+// 发一条请求并等到它的回复：回复之前投递的消息都已在它之前到达
+void request(Client& client, std::string_view message) {
+    client.send(message, Opcode::text);
+    CHECK_EQ(client.read().payload, "echo:" + std::string(message));
+}
+
+void test_stream_filter(WebSocketServer& server, MessagePool& pool, tcp::endpoint endpoint) {
+    Client all(endpoint);         // 从不订阅，收到所有消息
+    Client btc(endpoint);         // 只订阅trades:BTC
+    Client trades(endpoint);      // 订阅trades的所有instId
+    Client unsubscribed(endpoint);  // 只退订过，仍然收到所有消息
+    request(all, "hello");
+    request(btc, "sub:trades:BTC");
+    request(trades, "sub:trades:");
+    request(unsubscribed, "unsub:trades:BTC");
+
+    publish(server, pool, "trades", "BTC", 0, "m1");
+    publish(server, pool, "trades", "ETH", 1, "m2");
+    publish(server, pool, "books", "BTC", 2, "m3");
+    for (auto* client : {&all, &unsubscribed}) {
+        CHECK_EQ(client->read().payload, "m1");
+        CHECK_EQ(client->read().payload, "m2");
+        CHECK_EQ(client->read().payload, "m3");
+    }
+    CHECK_EQ(btc.read().payload, "m1");
+    CHECK_EQ(trades.read().payload, "m1");
+    CHECK_EQ(trades.read().payload, "m2");
+    request(btc, "ping");
+    request(trades, "ping");
+
+    // 增加订阅后新的流也开始投递；退订掉所有流后什么都收不到
+    request(btc, "sub:books:BTC");
+    publish(server, pool, "books", "BTC", 2, "m4");
+    CHECK_EQ(btc.read().payload, "m4");
+    request(btc, "unsub:trades:BTC");
+    request(btc, "unsub:books:BTC");
+    publish(server, pool, "trades", "BTC", 0, "m5");
+    publish(server, pool, "books", "BTC", 2, "m6");
+    request(btc, "ping");
+}
+
+} // namespace
+
+int main() {
+    MessagePool pool(4096, 64);
+    net::io_context ioc;
+    auto server = std::make_shared<WebSocketServer>(ioc, tcp::endpoint{net::ip::make_address("127.0.0.1"), 0},
+                                                    SocketProfile{}, pool, 0, false);
+    server->set_session_handlers(
+        [](std::uint64_t, std::string_view message) { return handle_request(message); },
+        [](std::uint64_t) {});
+    server->run();
+    std::thread worker([&ioc] { ioc.run(); });
+
+    auto const endpoint = server->local_endpoint();
+    test_echo_lengths(endpoint);
+    test_fragments_with_interleaved_ping(endpoint);
+    test_fragment_sequence_errors(endpoint);
+    test_protocol_errors(endpoint);
+    test_oversize(endpoint);
+    test_close_handshake(endpoint);
+    test_stream_filter(*server, pool, endpoint);
+
+    ioc.stop();
+    worker.join();
+    return check_result("ws_session_test");
+}